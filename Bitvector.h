@@ -1,7 +1,7 @@
 //  Classes Bitvector and BitvectorP
 //
 //  These classes supports simple operations on an array of bits.
-//  BitvectorP packes 8 bits in a byte, with some performance cost.
+//  BitvectorP packes 64 bits in a word, with some performance cost.
 //  Otherwise, the two classes are identical, and share the same interface:
 //  
 //  Constructors:
@@ -21,6 +21,14 @@
 //    void B.set(long pos);   -- does B[pos]=1 (inline)
 //    void B.clear(long pos); -- does B[pos]=0 (inline)
 //    int B[long pos];        -- returns the bit in position pos (inline)
+//    void B.set(long from, long to, long step);
+//    void B.clear(long from, long to, long step);
+//                            -- sets/clears bits from, from+step, ... < to
+//    long B.find_next_set(long pos);
+//                            -- returns the first i >= pos with B[i]=1,
+//                               or length() if there is none
+//  count(), clearall(), setall() and find_next_set() work a 64-bit word
+//  at a time, and so do BitvectorP's set/clear with a step below 64.
 //  Output operator:
 //    cout << B;              -- prints the vector, 80 bits per line
 //
@@ -30,6 +38,7 @@
 #define _BITVECTOR
 
 #include <iostream>
+#include <cstring>
 // #include "pause.h"
 
 class Bitvector
@@ -43,11 +52,12 @@ public:
   ~Bitvector() { if(x!=NULL) delete[] x; }
   inline long length() const { return len; }
   inline int operator!() const { return x==NULL; }
-  long count() const
+  long count() const  // each byte is 0 or 1, so a word's popcount counts 8
   {
-    long cnt=0;
-    for(long i=0; i<len; i++)
-      cnt+=(*this)[i];
+    long cnt=0, i;
+    unsigned long long w;
+    for(i=0; i+8<=len; i+=8) { memcpy(&w,x+i,8); cnt+=__builtin_popcountll(w); }
+    for(; i<len; i++) cnt+=x[i];
     return cnt;
   }
   void setsize(long bsize)
@@ -60,11 +70,27 @@ public:
     len=xlen=bsize;
     clearall();
   }
-  void clearall() { for(long i=0; i<xlen; i++) x[i]=0; }
+  void clearall() { memset(x,0,xlen); }
   inline int operator[](long i) const { return x[i]; }
   inline void set(long i) { x[i]=1; }
   inline void clear(long i) { x[i]=0; }
-  void setall() { for(long i=0; i<xlen; i++) x[i]=1; }
+  void setall() { memset(x,1,xlen); }
+  void set(long from, long to, long step)
+    { for(long i=from; i<to; i+=step) x[i]=1; }
+  void clear(long from, long to, long step)
+    { for(long i=from; i<to; i+=step) x[i]=0; }
+  long find_next_set(long i) const
+  {
+    unsigned long long w;
+    for(; i<len && (i&7); i++) if(x[i]) return i;
+    for(; i+8<=len; i+=8)
+    {
+      memcpy(&w,x+i,8);
+      if(w) return i+(__builtin_ctzll(w)>>3);
+    }
+    for(; i<len; i++) if(x[i]) return i;
+    return len;
+  }
 private:
   Bitvector(const Bitvector &); // disabled
   const Bitvector & operator=(const Bitvector &); // disabled
@@ -80,47 +106,95 @@ inline ostream & operator<<(ostream & os, const Bitvector & B)
 
 class BitvectorP
 {
-  unsigned char *x;
+  unsigned long long *x;
   long len;
-  long xlen;
+  long xlen;  // in words
 public:
   BitvectorP(): x(NULL), len(0), xlen(0) {}
   BitvectorP(long bsize): x(NULL), len(0), xlen(0) { setsize(bsize); }
   ~BitvectorP() { if(x!=NULL) delete[] x; }
   inline long length() const { return len; }
   inline int operator!() const { return x==NULL; }
-  long count() const
+  long count() const  // bits past len are always 0
   {
     long cnt=0;
-    for(long i=0; i<len; i++)
-      cnt+=(*this)[i];
+    for(long i=0; i<xlen; i++) cnt+=__builtin_popcountll(x[i]);
     return cnt;
   }
   void setsize(long bsize)
   {
     long newxlen;
     len=bsize;
-    newxlen=(bsize+7)/8+1;
+    newxlen=(bsize+63)/64+1;
     if(newxlen>xlen)
     {
       if(x!=NULL) delete[] x;
       xlen=newxlen;
-      x = new unsigned char[xlen];
+      x = new unsigned long long[xlen];
       if(x==NULL)
         { len=xlen=0;
           cerr<<"In BitvectorP::setsize(): insufficient memory.\n"; return; }
     }
     clearall();
   }
-  void clearall() { for(long i=0; i<xlen; i++) x[i]=0; }
-//inline int operator[](long i) const { check(i); return ((x[i>>3]>>(i&7))&1); }
-  inline int operator[](long i) const { return ((x[i>>3]>>(i&7))&1); }
-//inline void set(long i) { check(i); x[i>>3]|=(1<<(i&7)); }
-  inline void set(long i) { x[i>>3]|=(1<<(i&7)); }
-//inline void clear(long i) { check(i); x[i>>3]&= ~(1<<(i&7)); }
-  inline void clear(long i) { x[i>>3]&= ~(1<<(i&7)); }
-  void setall() { for(long i=0; i<xlen; i++) x[i]=(1<<8)-1; }
+  void clearall() { memset(x,0,xlen*8); }
+//inline int operator[](long i) const { check(i); return ((x[i>>6]>>(i&63))&1); }
+  inline int operator[](long i) const { return ((x[i>>6]>>(i&63))&1); }
+//inline void set(long i) { check(i); x[i>>6]|=(1ULL<<(i&63)); }
+  inline void set(long i) { x[i>>6]|=(1ULL<<(i&63)); }
+//inline void clear(long i) { check(i); x[i>>6]&= ~(1ULL<<(i&63)); }
+  inline void clear(long i) { x[i>>6]&= ~(1ULL<<(i&63)); }
+  void setall()
+  {
+    memset(x,0xff,xlen*8);
+    for(long i=len; i<xlen*64 && (i&63); i++) clear(i);  // keep the tail 0
+    for(long i=(len+63)/64; i<xlen; i++) x[i]=0;
+  }
+  void set(long from, long to, long step) { stride<true>(from,to,step); }
+  void clear(long from, long to, long step) { stride<false>(from,to,step); }
+  long find_next_set(long i) const
+  {
+    if(i>=len) return len;
+    long k=i>>6;
+    unsigned long long w=x[k]&(~0ULL<<(i&63));
+    while(!w)
+    {
+      if(++k>=(len+63)/64) return len;
+      w=x[k];
+    }
+    i=(k<<6)+__builtin_ctzll(w);
+    return i<len ? i : len;
+  }
 private:
+  // sets/clears bits from, from+step, ... < to.  For step < 64 that is a
+  // word at a time: the bits of a word whose first one is at r (mod step)
+  // are mask[r], and the next word's first one is at next[r].
+  template <bool SET> void stride(long from, long to, long step)
+  {
+    if(from>=to) return;
+    if(step>=64)
+    {
+      for(long i=from; i<to; i+=step)
+        if(SET) x[i>>6]|=1ULL<<(i&63); else x[i>>6]&=~(1ULL<<(i&63));
+      return;
+    }
+    unsigned long long mask[64];
+    int next[64];
+    for(long r=0; r<step; r++)
+    {
+      mask[r]=0;
+      for(long b=r; b<64; b+=step) mask[r]|=1ULL<<b;
+      next[r]=(int)((r+step-64%step)%step);
+    }
+    long k=from>>6, last=(to-1)>>6, r=(from&63)%step;
+    unsigned long long m=mask[r]&(~0ULL<<(from&63));
+    for(; k<=last; k++)
+    {
+      if(k==last) m&=~0ULL>>(63-((to-1)&63));
+      if(SET) x[k]|=m; else x[k]&=~m;
+      r=next[r]; m=mask[r];
+    }
+  }
   void check(long i) const
     { if((i<0)||(i>=len))
       {cout <<"Error: "<<i<<" out of range" << endl; /* pause(); */ }}
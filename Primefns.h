@@ -1,10 +1,12 @@
 
 // Mobius and Largest prime factor functions
+// and prefix sums of prime reciprocals (or other weights, see weight.h)
 
 #ifndef _PRIMEFNS
 #define _PRIMEFNS
 
 #include "Primelist.h"
+#include "weight.h"
 
 class Mulist  // table of Mobius function
 {
@@ -21,8 +23,7 @@ class Mulist  // table of Mobius function
             Primelist P(size);
             for (i=1;i<=size;i++) M[i] = 1;
             S = (int) sqrt((double)size);
-            if (DEBUG)
-                cerr << "Mulist: size = " << size << " S = " << S << endl;
+            LOG(MISC, DEBUG) << "Mulist: size = " << size << " S = " << S;
 
             P.reset();
             for (;;) {
@@ -86,13 +87,13 @@ class Spflist // table of smallest prime factor function
 {             // by convention Spf(1) = 1
 
     private:
-        long *S;
+        unsigned int *S;   // spf(i) <= i, so 32 bits do for any size we use
         int Ssize;
 
     public:
         Spflist(long size) {
             unsigned int i, p;
-            S = new long[size+1];
+            S = new unsigned int[size+1];
             Primelist P(size);
             S[1] = 1; for (i=0;i<=size;i++) S[i] = 0;
             P.reset();
@@ -112,10 +113,82 @@ class Spflist // table of smallest prime factor function
         void print() {
             long i;
             for (i=1;i<=Ssize;i++) {
-                printf("%ld %ld\n",i,S[i]);
+                printf("%ld %u\n",i,S[i]);
             }
         }
 
 };
 
+template <class Wt>
+class Primesums // sum of Wt::leaf(p) for p <= y, for any y up to size
+{               // in O(1): a base sum per 64-bit word of the mod 30
+                // wheel bitmap, plus the (at most 64) primes in that word
+
+    public:
+        typedef typename Wt::value value;
+
+    private:
+        const unsigned char *X;   // wheel bitmap covering [0, size]
+        unsigned long long *W;    // our own bitmap, if the cache has none
+        value *Base;              // sum for p < 240w, p = 2, 3, 5 included
+        long Xsize, Nwords;
+
+    public:
+        Primesums(long size) {
+            PERF_REGION("Primesums");
+            long nbytes = size/30+1, nwords = (nbytes+7)/8, w, i;
+            W = NULL;
+            X = Primecache::lookup(size);
+            if (X == NULL) {
+                W = Arena::make<unsigned long long>(nwords);
+                wheel_sieve(size, (unsigned char *)W, nwords);
+                X = (unsigned char *)W;
+            }
+            Base = Arena::make<value>(nwords+1);
+            Base[0] = Wt::leaf(2) + Wt::leaf(3) + Wt::leaf(5);
+            for (w=0;w<nwords;w++) {
+                Base[w+1] = Base[w];
+                for (i=8*w;i<8*w+8;i++)
+                    for (unsigned int t=X[i]; t; t&=t-1)
+                        Base[w+1] += Wt::leaf(30*i+PL_res[__builtin_ctz(t)]);
+            }
+            Xsize = size;
+            Nwords = nwords;
+        }
+
+        ~Primesums() {
+            if (W == NULL) Primecache::release(X);
+            Arena::release(W, Nwords); Arena::release(Base, Nwords+1);
+        }
+
+        value sum(long y) {  // need y <= size
+            if (y < 7) {
+                value s = Wt::zero();
+                if (y >= 2) s += Wt::leaf(2);
+                if (y >= 3) s += Wt::leaf(3);
+                if (y >= 5) s += Wt::leaf(5);
+                return s;
+            }
+            long j = y/30, i;
+            value s = Base[j/8];
+            for (i=j&~7L;i<j;i++)
+                for (unsigned int t=X[i]; t; t&=t-1)
+                    s += Wt::leaf(30*i+PL_res[__builtin_ctz(t)]);
+            for (unsigned int t=X[j]; t; t&=t-1) {
+                long p = 30*j+PL_res[__builtin_ctz(t)];
+                if (p > y) break;
+                s += Wt::leaf(p);
+            }
+            return s;
+        }
+
+        long size() { return Xsize; }
+
+    private:
+        Primesums(const Primesums &); // disabled
+        const Primesums & operator=(const Primesums &); // disabled
+};
+
+typedef Primesums<Wrecip> Recipsums;
+
 #endif
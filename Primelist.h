@@ -2,6 +2,10 @@
 //
 //  This class supports simple operations on a list of primes.
 //  It uses the Sieve of Eratosthenes to construct the list of primes.
+//  The sieve only stores numbers prime to 30 (8 flags per byte, one
+//  byte per 30 integers) and is done in cache-sized segments.  The
+//  primes are stored as 32-bit numbers whenever N < 2^32, which halves
+//  the size of the list.
 //  The Primelist class supports the following public functions:
 //
 //  Constructors:
@@ -24,24 +28,58 @@
 //
 //  The copy constructor and operator= are disabled.
 //
+//  The wheel bitmaps made by find() are kept in a prime table cache
+//  (class Primecache below), so later lists up to the same bound are
+//  just read off the bitmap instead of being sieved again.
+//
 //=========================================================================
 //
-//  Class ReversePrimelist
+//  Class Primecache
+//
+//  A process-wide, read-only mmap of a wheel bitmap file (same layout
+//  as the sieve in Primelist::find()).  All stages of a run, and later
+//  runs by the same user, share the one file.  The file is named by the
+//  environment variable PRIMECACHE, by default PrimeHarmonicSums.primes in
+//  $XDG_CACHE_HOME or else $HOME/.cache; PRIMECACHE=none turns the cache
+//  off.  The file is written under a mkstemp() name and renamed into
+//  place.  A file is only mapped if it belongs to us, is not writable by
+//  others, and its header (magic, limit, length, prime count and checksum)
+//  matches the bitmap.  Bitmaps for N < PC_MINLIMIT are cheap to sieve and
+//  are never written.
 //
-//  This class is an array r[] of indexes into a Primelist P such that
-//  P[r[x]] is the smallest prime >= x, with the exception that
-//  P[r[x]]=P.max() for x>P.max().
+//  Static functions:
+//    const unsigned char *Primecache::lookup(long N)
+//                         -- returns a bitmap covering [0, N], or NULL
+//    void Primecache::release(const unsigned char *x)
+//                         -- done with a bitmap from lookup(); a map the
+//                            cache has since replaced is unmapped once
+//                            nobody holds it
+//    void Primecache::store(long N, const unsigned char *x, long nbytes)
+//                         -- saves a freshly sieved bitmap for [0, N]
+//                            if it is larger than the cached one
+//    void Primecache::reserve(long N)
+//                         -- makes sure the cache covers [0, N]; call this
+//                            first with the largest bound a run will need
+//
+//=========================================================================
+//
+//  Class Primeindex
+//
+//  pi(y), the nth prime and the next prime, each in O(1), from the wheel
+//  bitmap of [0, N] (one byte per 30 integers) and a count per 64-byte
+//  line of it: about 0.3 bits per integer in all, so 370 MB at N = 10^10.
+//  The bitmap is read from the prime table cache when it covers N.
 //
 //  Constructor:
-//    ReversePrimelist R(const Primelist & P, long max=0)
-//                         -- initializes R as described above,
-//                            for x<=max (if max==0, P.max() is used)
+//    Primeindex I(long N) -- indexes the primes up to N
 //  Standard functions:
-//    long R[long x];      -- returns smallest i such that P[i]>=x (see above)
-//    int !R;              -- returns true if the constructor failed
-//    long R.length();     -- returns the largest valid x to use in R[x] (max)
+//    long I.pi(long y);   -- number of primes <= y (y > N counts as N)
+//    long I.nth(long n);  -- the nth prime, 1 <= n <= pi(N), nth(1) = 2
+//    long I.next(long x); -- smallest prime >= x, or 0 if it is past N
+//    long I.max();        -- N
 //
-//  The copy constructor and operator= are disabled.
+//  It replaces ReversePrimelist, an index into a Primelist with a long
+//  per integer.  The copy constructor and operator= are disabled.
 
 #ifndef _PRIMELIST
 #define _PRIMELIST
@@ -49,51 +87,335 @@
 using namespace std;
 #include <iostream>
 #include <iomanip>
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mutex>
+#include <string>
+#include <vector>
 
 // As sent this was
 // #include <iostream.h>
 // #include <iomanip.h>
 
 #include "Bitvector.h"
+#include "perfregion.h"
+
+// Mod 30 wheel used by Primelist::find().  Byte j of the sieve holds
+// the flags for 30j+1, 30j+7, ..., 30j+29, in that order.
+
+static const int PL_res[8] = { 1, 7, 11, 13, 17, 19, 23, 29 };
+static const int PL_gap[8] = { 6, 4, 2, 4, 2, 4, 6, 2 };   // PL_res[i+1]-PL_res[i]
+static const int PL_bit[30] = { -1, 0,-1,-1,-1,-1,-1, 1,-1,-1,
+                                -1, 2,-1, 3,-1,-1,-1, 4,-1, 5,
+                                -1,-1,-1, 6,-1,-1,-1,-1,-1, 7 };
+
+#define PL_SEGBYTES 32768  // sieve segment, should fit in L1/L2 cache
+
+// Sieves the wheel bitmap for [0, N] into x, which has nwords*8 bytes.
+// Flags past N are cleared.
+void wheel_sieve(long N, unsigned char *x, long nwords)
+{
+  PERF_REGION("wheel_sieve");
+  long i,p;
+  long nbytes=N/30+1;          // byte j covers [30j, 30j+30)
+  memset(x,0xff,nwords*8);
+  x[0]&=~1;  // 1 is not prime
+  for(i=0; i<8; i++)  // drop the flags past N in the last byte
+    if(30*(nbytes-1)+PL_res[i]>N) x[nbytes-1]&=~(1<<i);
+  memset(x+nbytes,0,nwords*8-nbytes);
+
+  // sieving primes up to sqrt(N), with a plain odd-only sieve
+  long s=(long)sqrt((double)N);
+  while(s*s>N) s--;
+  while((s+1)*(s+1)<=N) s++;
+  unsigned char *small=new unsigned char[s+1];
+  memset(small,1,s+1);
+  for(p=3; p*p<=s; p+=2) if(small[p])
+    for(i=p*p; i<=s; i+=2*p) small[i]=0;
+  long nsp=0;
+  for(p=7; p<=s; p+=2) if(small[p]) nsp++;
+  long *sp=new long[nsp];   // sieving prime
+  long long *mult=new long long[nsp]; // next multiple to strike
+  int *wi=new int[nsp];    // wheel index of mult/sp
+  for(p=7, i=0; p<=s; p+=2) if(small[p])
+    { sp[i]=p; mult[i]=(long long)p*p; wi[i]=PL_bit[p%30]; i++; }
+  delete[] small;
+
+  // segmented sieve: strike p*q for q >= p prime to 30
+  for(long seg=0; seg<nbytes; seg+=PL_SEGBYTES)
+  {
+    long long seghi=30LL*(seg+PL_SEGBYTES);
+    if(seghi>30LL*nbytes) seghi=30LL*nbytes;
+    for(i=0; i<nsp; i++)
+    {
+      long long m=mult[i];
+      int w=wi[i];
+      p=sp[i];
+      while(m<seghi)
+      {
+        x[m/30]&=~(1<<PL_bit[m%30]);
+        m+=p*PL_gap[w];
+        w=(w+1)&7;
+      }
+      mult[i]=m; wi[i]=w;
+    }
+  }
+  delete[] sp; delete[] mult; delete[] wi;
+}
+
+//=========================================================================
+
+#define PC_MINLIMIT 10000000  // smaller bitmaps are not worth caching
+
+struct PC_header    // file layout: header, then the bitmap
+{
+  char magic[8];    // "PHSWHL2"
+  long limit;       // bitmap covers [0, limit]
+  long nbytes;      // limit/30+1
+  long count;       // flags set in the bitmap
+  unsigned long long sum;  // checksum of the bitmap
+};
+
+class Primecache
+{
+  private:
+    static const unsigned char *map;  // mmapped file, or NULL
+    static long limit;
+    static size_t maplen;             // length of the mapping
+    static long users;                // lookups of map not yet released
+
+    struct Oldmap { const unsigned char *map; size_t len; long users; };
+    static vector<Oldmap> old;        // replaced maps still in use
+
+    static string path()  // "" for no cache
+    {
+      const char *s=getenv("PRIMECACHE");
+      if(s!=NULL) return (*s==0 || !strcmp(s,"none")) ? "" : s;
+      string d;
+      if((s=getenv("XDG_CACHE_HOME"))!=NULL && *s=='/') d=s;
+      else if((s=getenv("HOME"))!=NULL && *s=='/') { d=s; d+="/.cache"; }
+      else return "";
+      mkdir(d.c_str(),0700);  // the parent has to exist already
+      return d+"/PrimeHarmonicSums.primes";
+    }
+
+    // count and checksum (FNV-1a over 64-bit words) of a bitmap
+    static void digest(const unsigned char *x, long nbytes, long &count, unsigned long long &sum)
+    {
+      long i;
+      count=0; sum=14695981039346656037ULL;
+      for(i=0; i+8<=nbytes; i+=8)
+      {
+        unsigned long long w;
+        memcpy(&w,x+i,8);
+        count+=__builtin_popcountll(w);
+        sum=(sum^w)*1099511628211ULL;
+      }
+      for(; i<nbytes; i++)
+      {
+        count+=__builtin_popcount(x[i]);
+        sum=(sum^x[i])*1099511628211ULL;
+      }
+    }
+
+    static mutex &lock()  // stages may run in parallel threads
+    {
+      static mutex m;
+      return m;
+    }
+
+    static void remap()  // maps the file if it is larger than what we have
+    {
+      string f=path();
+      if(f.empty()) return;
+      int fd=open(f.c_str(),O_RDONLY);
+      if(fd<0) return;
+      struct stat st;
+      PC_header h;
+      if(fstat(fd,&st)==0 && S_ISREG(st.st_mode) && st.st_uid==geteuid()
+         && !(st.st_mode&(S_IWGRP|S_IWOTH))
+         && read(fd,&h,sizeof(h))==sizeof(h)
+         && !memcmp(h.magic,"PHSWHL2",8) && h.limit>limit
+         && h.nbytes==h.limit/30+1
+         && st.st_size==(off_t)(sizeof(h)+h.nbytes))
+      {
+        void *m=mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+        if(m!=MAP_FAILED)
+        {
+          long count;
+          unsigned long long sum;
+          digest((const unsigned char *)m+sizeof(h),h.nbytes,count,sum);
+          if(count==h.count && sum==h.sum)
+          {
+            if(map!=NULL)  // the old map stays valid while anyone holds it
+            {
+              if(users>0) { Oldmap o={map,maplen,users}; old.push_back(o); }
+              else munmap((void *)map,maplen);
+            }
+            map=(const unsigned char *)m; maplen=st.st_size; limit=h.limit; users=0;
+          }
+          else munmap(m,st.st_size);
+        }
+      }
+      close(fd);
+    }
+
+  public:
+    static const unsigned char *lookup(long N)
+    {
+      if(N<PC_MINLIMIT) return NULL;
+      lock_guard<mutex> g(lock());
+      if(limit<N) remap();
+      if(limit<N) return NULL;
+      users++;
+      return map+sizeof(PC_header);
+    }
+
+    static void release(const unsigned char *x)
+    {
+      if(x==NULL) return;
+      lock_guard<mutex> g(lock());
+      if(x==map+sizeof(PC_header)) { users--; return; }
+      for(size_t i=0; i<old.size(); i++)
+        if(x==old[i].map+sizeof(PC_header))
+        {
+          if(--old[i].users==0)
+          {
+            munmap((void *)old[i].map,old[i].len);
+            old.erase(old.begin()+i);
+          }
+          return;
+        }
+    }
+
+    static void store(long N, const unsigned char *x, long nbytes)
+    {
+      string f=path();
+      if(f.empty() || N<PC_MINLIMIT) return;
+      lock_guard<mutex> g(lock());
+      if(N<=limit) return;
+      string tmp=f+".XXXXXX";
+      int fd=mkstemp(&tmp[0]);
+      if(fd<0) return;
+      FILE *fp=fdopen(fd,"wb");
+      if(fp==NULL) { close(fd); unlink(tmp.c_str()); return; }
+      PC_header h;
+      memset(&h,0,sizeof(h));
+      memcpy(h.magic,"PHSWHL2",8);
+      h.limit=N; h.nbytes=nbytes;
+      digest(x,nbytes,h.count,h.sum);
+      int ok=fwrite(&h,sizeof(h),1,fp)==1 && fwrite(x,1,nbytes,fp)==(size_t)nbytes;
+      ok=(fclose(fp)==0) && ok;
+      // rename() is atomic, so concurrent runs never see a partial file
+      if(!ok || rename(tmp.c_str(),f.c_str())!=0) { unlink(tmp.c_str()); return; }
+      remap();
+    }
+
+    static void reserve(long N)
+    {
+      const unsigned char *x=lookup(N);
+      if(x!=NULL) { release(x); return; }
+      if(path().empty() || N<PC_MINLIMIT) return;
+      long nwords=(N/30+1+7)/8;
+      unsigned long long *W=new unsigned long long[nwords];
+      wheel_sieve(N,(unsigned char *)W,nwords);
+      store(N,(unsigned char *)W,N/30+1);
+      delete[] W;
+    }
+};
+
+const unsigned char *Primecache::map=NULL;
+long Primecache::limit=0;
+size_t Primecache::maplen=0;
+long Primecache::users=0;
+vector<Primecache::Oldmap> Primecache::old;
+
+//=========================================================================
 
 class Primelist
 {
   private:
-    long *P;  // points to array of primes
+    long *P;  // points to array of primes (N >= 2^32)
+    unsigned int *P32;  // points to array of primes (N < 2^32)
     long len;  // length of the array
     long pos;  // position for an iterator
 
   public:
-    Primelist(): P(NULL), len(0), pos(0) {}
-    Primelist(long N): P(NULL), len(0), pos(0) { find(N); }
-    ~Primelist() { if(P!=NULL) delete[] P; }
+    Primelist(): P(NULL), P32(NULL), len(0), pos(0) {}
+    Primelist(long N): P(NULL), P32(NULL), len(0), pos(0) { find(N); }
+    ~Primelist() { clear(); }
 
-    inline long operator[](long i) const { return P[i]; }
-    inline long max() const              { return P[len-1]; }
+    inline long operator[](long i) const { return P32!=NULL ? (long)P32[i] : P[i]; }
+    inline long max() const              { return (*this)[len-1]; }
     inline long length() const           { return len; }
     inline void reset(long start=0)      { pos=start; }
-    inline long next()                   { return P[pos++]; }
+    inline long next()                   { return (*this)[pos++]; }
     inline int operator!() const         { return len==0; }
 
     void find(long N)  // finds the primes up to N
     {
+      PERF_REGION("Primelist::find");
       pos=0;
-      if(P!=NULL) { delete[] P; len=0; }
-      BitvectorP x(N+1);
-      if(!x) return;  // failed!
+      clear();
+      if(N<2) return;
+
+      long i;
+      long nbytes=N/30+1;          // byte j covers [30j, 30j+30)
+      unsigned long long *W=NULL;
+      const unsigned char *x=Primecache::lookup(N);
+      if(x==NULL)
+      {
+        long nwords=(nbytes+7)/8;
+        W=new unsigned long long[nwords];
+        if(W==NULL) return;  // failed!
+        wheel_sieve(N,(unsigned char *)W,nwords);
+        Primecache::store(N,(unsigned char *)W,nbytes);
+        x=(unsigned char *)W;
+      }
 
-      long i,p,q;
-      x.set(2);
-      for(i=3; i<=N; i+=2) x.set(i);
-      for(p=3; p*p<=N; p+=2)
-        for(q=p*p; q<=N; q+=2*p) x.clear(q);
-      len=x.count();
-      P=new long[len];
-      if(P==NULL) { len=0; return; }
-      for(i=0, len=0; i<=N; i++) if(x[i]) P[len++]=i;
+      // flags of the last byte that are <= N (the cache may go further)
+      unsigned int last=0;
+      for(i=0; i<8; i++) if(30*(nbytes-1)+PL_res[i]<=N) last|=1<<i;
+
+      len=(N>=2)+(N>=3)+(N>=5);
+      for(i=0; i+8<nbytes; i+=8)
+      {
+        unsigned long long w;
+        memcpy(&w,x+i,8);
+        len+=__builtin_popcountll(w);
+      }
+      for(; i<nbytes-1; i++) len+=__builtin_popcount(x[i]);
+      len+=__builtin_popcount(x[nbytes-1]&last);
+
+      if(N<4294967296LL) P32=new unsigned int[len];
+      else P=new long[len];
+      if(P32==NULL && P==NULL) { len=0; if(W==NULL) Primecache::release(x); delete[] W; return; }
+
+      long n=0;
+      if(N>=2) put(n++,2);
+      if(N>=3) put(n++,3);
+      if(N>=5) put(n++,5);
+      for(i=0; i<nbytes; i++)
+        for(unsigned int t=(i<nbytes-1 ? x[i] : x[i]&last); t; t&=t-1)
+          put(n++,30*i+PL_res[__builtin_ctz(t)]);
+      if(W==NULL) Primecache::release(x);
+      delete[] W;
     }
 
   private:
+    inline void put(long i, long p) { if(P32!=NULL) P32[i]=p; else P[i]=p; }
+    void clear()
+    {
+      if(P!=NULL) { delete[] P; P=NULL; }
+      if(P32!=NULL) { delete[] P32; P32=NULL; }
+      len=0;
+    }
     Primelist(const Primelist &); // disabled
     const Primelist & operator=(const Primelist &); // disabled
 };
@@ -111,30 +433,190 @@ inline ostream & operator<<(ostream & os, const Primelist & P)
 
 //=========================================================================
 
-class ReversePrimelist // gives # of primes < i (EB)
+// Wheel sieve of consecutive segments starting at lo (a multiple of 30),
+// for sweeps that don't start at 0.  next() sieves the following 30*nbytes
+// integers into x, in the layout of wheel_sieve (byte j covering lo+30j).
+// Each sieving prime keeps the byte of its next multiple, relative to the
+// next segment, and where it is on the wheel; the byte steps and bit masks
+// of its 8 wheel positions depend only on p mod 30 and are tabulated, so
+// only the constructor divides.  The primes of P must reach sqrt(hi),
+// where hi is the end of the last segment.
+class Rangesieve
+{
+  private:
+    long nsp;            // number of sieving primes
+    long long *off;      // byte of the next multiple, from the next segment
+    int *wi;             // wheel index of (next multiple)/p
+    int *step;           // 8 per prime: bytes to the multiple after
+    unsigned char *mask; // 8 per prime: clears the bit of the multiple
+    long long lo;        // start of the next segment
+
+  public:
+    Rangesieve(const Primelist &P, long long start, long long hi) : lo(start)
+    {
+      long i;
+      int w;
+      for(nsp=0; nsp+3<P.length() && (long long)P[nsp+3]*P[nsp+3]<hi; nsp++) ;
+      off=new long long[nsp]; wi=new int[nsp];
+      step=new int[8*nsp]; mask=new unsigned char[8*nsp];
+      for(i=0; i<nsp; i++)
+      {
+        long long p=P[i+3];
+        long long q=(lo+p-1)/p;   // strike p*q for q >= p prime to 30
+        if(q<p) q=p;
+        while(PL_bit[q%30]<0) q++;
+        off[i]=(p*q-lo)/30; wi[i]=PL_bit[q%30];
+        for(w=0; w<8; w++)
+        {
+          int r=p*PL_res[w]%30;
+          step[8*i+w]=(r+p*PL_gap[w])/30;
+          mask[8*i+w]=~(1<<PL_bit[r]);
+        }
+      }
+    }
+
+    ~Rangesieve() { delete[] off; delete[] wi; delete[] step; delete[] mask; }
+
+    void next(unsigned char *x, long nbytes)
+    {
+      PERF_REGION("Rangesieve::next");
+      memset(x,0xff,nbytes);
+      if(lo==0) x[0]&=~1;  // 1 is not prime
+      for(long i=0; i<nsp; i++)
+      {
+        long long j=off[i];
+        int w=wi[i];
+        const int *s=step+8*i;
+        const unsigned char *m=mask+8*i;
+        while(j<nbytes)
+        {
+          x[j]&=m[w];
+          j+=s[w];
+          w=(w+1)&7;
+        }
+        off[i]=j-nbytes; wi[i]=w;
+      }
+      lo+=30LL*nbytes;
+    }
+
+  private:
+    Rangesieve(const Rangesieve &); // disabled
+    const Rangesieve & operator=(const Rangesieve &); // disabled
+};
+
+//=========================================================================
+
+#define PI_LINE 64        // bytes of bitmap (1920 integers) per count
+#define PI_SAMPLE 4096    // nth() keeps the line of every PI_SAMPLE-th prime
+
+// Wheel flags with residue <= r, for r = 0..29
+static const unsigned char PL_upto[30] = {
+    0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x03, 0x03, 0x03,
+    0x03, 0x07, 0x07, 0x0f, 0x0f, 0x0f, 0x0f, 0x1f, 0x1f, 0x3f,
+    0x3f, 0x3f, 0x3f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0xff };
+
+class Primeindex
 {
-    long *r;
-    long rlen;
+  private:
+    const unsigned char *X;   // wheel bitmap; the last line is in tail
+    unsigned long long *W;    // our own bitmap, if the cache has none
+    unsigned char tail[PI_LINE];  // last line, cleared past N
+    long long *base;          // wheel primes (7 on) before each line
+    long *sample;             // line of wheel prime 1 + PI_SAMPLE s
+    long N, nlines, nsample;
+
+    const unsigned char *line(long l) const { return l < nlines-1 ? X+PI_LINE*l : tail; }
+
+    // wheel primes in line l before byte b
+    long count(long l, long b) const
+    {
+      const unsigned char *x=line(l);
+      long c=0, i=0;
+      for(; i+8<=b; i+=8)
+      {
+        unsigned long long w;
+        memcpy(&w,x+i,8);
+        c+=__builtin_popcountll(w);
+      }
+      for(; i<b; i++) c+=__builtin_popcount(x[i]);
+      return c;
+    }
+
   public:
-    ~ReversePrimelist() { if(r!=NULL) delete[] r; }
-    long operator[](long i) const { return r[i]; }
-    int operator!() const { return rlen==0; }
-    long length() const { return rlen; }
-    ReversePrimelist(const Primelist & P, long max=0)
-    {
-      if(max==0) rlen=P.max()+1;
-      else rlen=max+1;
-      r = new long[rlen];
-      if(r==NULL) { rlen=0; return; }
-      r[0]=r[1]=r[2]=0;
-      for(long i=1; i<P.length(); i++)
-        for(long j=P[i-1]+1; j<=P[i]; j++) r[j]=i;
-      for(long j=P.max(); j<rlen; j++)
-        r[j]=P.length()-1;
+    Primeindex(long n) : W(NULL), N(n)
+    {
+      PERF_REGION("Primeindex");
+      long nbytes=N/30+1, l;
+      nlines=(nbytes+PI_LINE-1)/PI_LINE;
+      X=Primecache::lookup(N);
+      if(X==NULL)
+      {
+        long nwords=(nbytes+7)/8;
+        W=new unsigned long long[nwords];
+        wheel_sieve(N,(unsigned char *)W,nwords);
+        X=(unsigned char *)W;
+      }
+      memset(tail,0,PI_LINE);
+      memcpy(tail,X+PI_LINE*(nlines-1),nbytes-PI_LINE*(nlines-1));
+      long last=nbytes-1-PI_LINE*(nlines-1);   // the cache may go past N
+      tail[last]&=PL_upto[N-30*(nbytes-1)];
+
+      base=new long long[nlines+1];
+      base[0]=0;
+      for(l=0; l<nlines; l++) base[l+1]=base[l]+count(l,PI_LINE);
+      nsample=base[nlines]/PI_SAMPLE+1;
+      sample=new long[nsample];
+      long s=0;
+      for(l=0; l<nlines; l++)
+        while(s<nsample && base[l+1]>(long long)s*PI_SAMPLE) sample[s++]=l;
+      while(s<nsample) sample[s++]=nlines-1;
     }
+
+    ~Primeindex() { if(W==NULL) Primecache::release(X); delete[] W; delete[] base; delete[] sample; }
+
+    long max() const { return N; }
+
+    long pi(long y) const
+    {
+      if(y>N) y=N;
+      if(y<7) return (y>=2)+(y>=3)+(y>=5);
+      long j=y/30, l=j/PI_LINE;
+      return 3+base[l]+count(l,j%PI_LINE)+__builtin_popcount(line(l)[j%PI_LINE]&PL_upto[y%30]);
+    }
+
+    long nth(long n) const
+    {
+      if(n<=3) return n==1 ? 2 : n==2 ? 3 : 5;
+      long long k=n-3;   // kth wheel prime
+      long lo=sample[(k-1)/PI_SAMPLE], hi=(k-1)/PI_SAMPLE+1<nsample ? sample[(k-1)/PI_SAMPLE+1] : nlines-1;
+      while(lo<hi)       // last line with base < k
+      {
+        long mid=(lo+hi+1)/2;
+        if(base[mid]<k) lo=mid; else hi=mid-1;
+      }
+      const unsigned char *x=line(lo);
+      k-=base[lo];
+      long b=0;
+      for(;; b++)
+      {
+        int c=__builtin_popcount(x[b]);
+        if(k<=c) break;
+        k-=c;
+      }
+      unsigned int t=x[b];
+      while(--k) t&=t-1;
+      return 30*(PI_LINE*lo+b)+PL_res[__builtin_ctz(t)];
+    }
+
+    long next(long x) const
+    {
+      long n=pi(x-1)+1;
+      return n<=pi(N) ? nth(n) : 0;
+    }
+
   private:
-    ReversePrimelist(const ReversePrimelist &); // disabled
-    const ReversePrimelist & operator=(const ReversePrimelist &); // disabled
+    Primeindex(const Primeindex &); // disabled
+    const Primeindex & operator=(const Primeindex &); // disabled
 };
 
 #endif
@@ -5,8 +5,8 @@
 // Implements a compact sieveable array using a b-ary tree.
 // Space needed for s bits is approximately s bytes + s/b numbers.
 // Since we want a small structure, we only store a bit indicating
-// whether a leaf is zero, and recompute its value (1/t) 
-// as needed.  The goal of this is to reduce cache misses, which it
+// whether a leaf is zero, and recompute its value (1/t, or whatever
+// leaf weight it is given; see weight.h) as needed.  The goal of this is to reduce cache misses, which it
 // is hoped compensates us for the time to recompute.
 
 // Example: s = 10, b=3
@@ -26,6 +26,12 @@
 // Note: this is the "old" design in which b is fixed.  Some code
 // to use this is in special.cpp.fix
 
+// Lazy mode: a leaf cleared by sift() (or set by reset()) only updates
+// its parent and the root, so total() is always there; the levels in
+// between are out of date until the next prefix(), which recomputes them
+// from their children, (number of nodes) * b adds.  That pays when there
+// are many sifts per prefix, as in phi_s's later segments.
+
 #ifndef _RANGEARRAY
 #define _RANGEARRAY
 
@@ -35,36 +41,48 @@
 #include <cmath>
 
 #include "Primelist.h"
-
-#define recip(x) 1.0/(x)
+#include "weight.h"
 
 using namespace std;
-using namespace NTL;
 
-class RangeArray  // sieveable array w/ fast prefix sum capability
-{                 // the leaf for t = offset+i has the value 1/t
-    // if you want to change this look for places 
-    // marked with ###
+// RangeArrayT<LB> has the fixed degree b = 2^LB, so the index arithmetic
+// below turns into shifts and masks and the sibling loops can unroll.
+// RangeArrayT<0> (= RangeArray) takes any degree at run time.  The leaf
+// weight W is a policy from weight.h; with Wcount the tree is exact.
+
+template <int LB, class W = Wrecip>
+class RangeArrayT  // sieveable array w/ fast prefix sum capability
+{                 // the leaf for t = offset+i has the value W::leaf(t)
+    public:
+        typedef typename W::value value;
 
     private:
         char *B; // bit array; 1 for in, 0 for out;
         long long offset; // can't be 0 unless we pre-sieve by 2
-        unsigned long size; // we assume size > 1
-        ftype *T; // tree of sums
+        long size; // we assume size > 1
+        value *T; // tree of sums
         long b; // branching factor
         long tsize; // number of nodes
         long lc;   // left corner == B0's parent
+        long bot;  // first node of the level above the bits
+        bool lazy, stale;   // stale: nodes 1..bot-1 are out of date
+
+        // parent of node p, and rank of p among its siblings
+        inline long up(long p) const
+            { return LB ? (p-1) >> LB : (p-1)/b; }
+        inline long rank(long p) const
+            { return LB ? (p-1) & ((1L << LB) - 1) : (p-1)%b; }
 
     public:
         // constructor
-        inline RangeArray(const long long o, const long s, const long d) {
-            unsigned long long pow;
+        inline RangeArrayT(const long long o, const long s, const long d, bool lz = false) {
+            long long pow;
 
             offset = o;
             size = s;
-            B = new char[size];
+            B = Arena::make<char>(size);
 
-            b = d;
+            b = LB ? 1L << LB : d;
             lc = 0; pow = 1;    // find left corner (can screw up if b is large)
             while (pow < s) {   // and compute # of actual tree nodes
                 lc += pow;
@@ -72,16 +90,18 @@ class RangeArray  // sieveable array w/ fast prefix sum capability
             }
 
             tsize = (lc+s-2)/b + 1;
-            T = new ftype[tsize];
+            T = Arena::make<value>(tsize);
+            bot = up(lc);
+            lazy = lz;
 
             reset(offset);
         }
 
         void reset(long long o) { // we assume size doesn't change
-            ftype t;
-            unsigned long i, p;
+            value t;
+            long i, p;
 
-            for (i=0;i<tsize;i++)  T[i] = 0;
+            for (i=0;i<tsize;i++)  T[i] = W::zero();
 
             offset = o;
 
@@ -92,26 +112,32 @@ class RangeArray  // sieveable array w/ fast prefix sum capability
             // if you don't want to do this replace the next line by
             // for (i=0;i<size;i++)  
 
+            stale = lazy;
             for (i=odd;i<size;i+=2)  { // turn odd bits on and compute subtree totals
-                t = offset+i; t = recip(t); // ###
+                t = W::leaf(offset+i);
                 B[i] = 1;
-                p = (lc+i-1)/b;
+                p = up(lc+i);
+                if (lazy) {
+                    T[p] += t;
+                    if (p) T[0] += t;
+                    continue;
+                }
                 for (;;) {
                     T[p] += t;
                     if (!p) break;
-                    p = (p-1)/b;
+                    p = up(p);
                 }
             }
         }
 
-        ~RangeArray() { // destructor, called at block/proc exit
-            if (B!=NULL) delete[]B; 
-            if (T!=NULL) delete[]T; 
+        ~RangeArrayT() { // destructor, called at block/proc exit
+            Arena::release(B, size);
+            Arena::release(T, tsize);
         }
 
         void print() {                 // prints bit array and sum tree
             long i, rc, pow;
-            printf("offset = %lld  size = %lu.\n",offset,size);
+            printf("offset = %lld  size = %ld.\n",offset,size);
             printf("b = %ld  tsize = %ld  lc = %ld\n",b,tsize,lc);
             return; // delete to get more info
             for (i=0;i<size;i++) {
@@ -131,42 +157,127 @@ class RangeArray  // sieveable array w/ fast prefix sum capability
         }
 
         void sift(const long d) { // clears every d-th Bi
-            ftype t;
-            unsigned long i, p;
+            value t;
+            long i, p;
             i = d - (offset%d); if (i==d) i=0; // min i s.t. offset+i == 0 mod d
             for (;i<size;i+=d) if (B[i]) {
-                t = offset+i; t = recip(t); // ###
+                t = W::leaf(offset+i);
                 B[i] = 0;
-                p = (lc+i-1)/b;
+                p = up(lc+i);
+                if (lazy) {
+                    T[p] -= t;
+                    if (p) { T[0] -= t; stale = true; }
+                    continue;
+                }
                 for (;;) {
                     T[p] -= t;
                     if (!p) break;
-                    p = (p-1)/b;
+                    p = up(p);
                 }
             }
         }
 
-        ftype prefix(const long i) {  // sum values @ offset+0..i; need 0 <= i < s.
-            unsigned long r, p, j;
-            ftype t, s;
-            r = i%b; // rank of i compared to its siblings, counted from 0
-            s = 0;
-            for (j=i-r;j<=i;j++) if (B[j]) {t = offset+j; s += recip(t);}
-            p = (lc+i-1)/b;
+        value prefix(const long i) {  // sum values @ offset+0..i; need 0 <= i < s.
+            long r, p, j;
+            value s;
+            r = LB ? i & ((1L << LB) - 1) : i%b; // rank of i compared to its siblings, counted from 0
+            s = W::zero();
+            if (stale) refresh();
+            for (j=i-r;j<=i;j++) if (B[j]) s += W::leaf(offset+j);
+            p = up(lc+i);
             while (p) {
-                r = (p-1)%b;
-                for (j=p-r;j<p;j++) s += T[j]; // ###
-                p = (p-1)/b;
+                r = rank(p);
+#pragma GCC unroll 16
+                for (j=p-r;j<p;j++) s += T[j];
+                p = up(p);
             }
             return(s);
         }
 
-        ftype total() { // fast way to get to prefix(s-1)
+        value total() { // fast way to get to prefix(s-1)
             return(T[0]);
         }
 
+        const char *bits() const { return B; }  // B[i] != 0 iff offset+i is still in
+
+    private:
+        void refresh() {   // brings nodes 1..bot-1 up to date, children first
+            for (long p = bot-1; p >= 1; p--) {
+                long c = LB ? (p << LB) + 1 : p*b + 1, e = min(c + b, tsize);
+                value s = W::zero();
+                for (; c < e; c++) s += T[c];
+                T[p] = s;
+            }
+            stale = false;
+        }
+};
+
+typedef RangeArrayT<0> RangeArray;
+
+// Holds a RangeArrayT for whichever degree it is given, so callers that
+// change degree (phi_s) get the shift/mask version for the powers of two
+// they use.  Each call dispatches on a switch that is constant for the
+// life of the object, so the branch is always predicted.
+template <class W = Wrecip>
+class RangeArrayAnyT
+{
+    public:
+        typedef typename W::value value;
+
+    private:
+        int lb;    // log2 of the degree, or 0 for the general version
+        void *R;
+
+    public:
+#define RA_CASES(X) X(2) X(3) X(4) X(6) X(7) X(11) X(21)
+#define RA_DISPATCH(call) \
+        switch (lb) { \
+            case 2: return ((RangeArrayT<2, W> *)R)->call; \
+            case 3: return ((RangeArrayT<3, W> *)R)->call; \
+            case 4: return ((RangeArrayT<4, W> *)R)->call; \
+            case 6: return ((RangeArrayT<6, W> *)R)->call; \
+            case 7: return ((RangeArrayT<7, W> *)R)->call; \
+            case 11: return ((RangeArrayT<11, W> *)R)->call; \
+            case 21: return ((RangeArrayT<21, W> *)R)->call; \
+            default: return ((RangeArrayT<0, W> *)R)->call; \
+        }
+
+        RangeArrayAnyT(const long long o, const long s, const long d, bool lazy = false) {
+            for (lb = 1; lb < 62 && (1L << lb) < d; lb++) ;
+            switch (lb) {
+#define RA_NEW(n) case n: if (d == 1L << n) { R = new RangeArrayT<n, W>(o, s, d, lazy); return; } break;
+                RA_CASES(RA_NEW)
+#undef RA_NEW
+            }
+            lb = 0;
+            R = new RangeArrayT<0, W>(o, s, d, lazy);
+        }
+
+        ~RangeArrayAnyT() {
+            switch (lb) {
+#define RA_DEL(n) case n: delete (RangeArrayT<n, W> *)R; return;
+                RA_CASES(RA_DEL)
+#undef RA_DEL
+                default: delete (RangeArrayT<0, W> *)R;
+            }
+        }
+
+        void reset(long long o) { RA_DISPATCH(reset(o)) }
+        void sift(const long d) { RA_DISPATCH(sift(d)) }
+        value prefix(const long i) { RA_DISPATCH(prefix(i)) }
+        value total() { RA_DISPATCH(total()) }
+        const char *bits() const { RA_DISPATCH(bits()) }
+        void print() { RA_DISPATCH(print()) }
+#undef RA_DISPATCH
+#undef RA_CASES
+
+    private:
+        RangeArrayAnyT(const RangeArrayAnyT &); // disabled
+        const RangeArrayAnyT & operator=(const RangeArrayAnyT &); // disabled
 };
 
+typedef RangeArrayAnyT<> RangeArrayAny;
+
 // Two testing routines for this module
 
 
@@ -194,7 +305,7 @@ void Htest(long n) { // computes and prints first n odd-harmonic numbers
 
 void Stest(long n) { // computes and prints sum of 1/p for p <= n
     long s, p;
-    ftype t, total;
+    ftype total;
     s = (int) sqrt(n)+1;
     cout << n << endl;
     cout << s << endl;
@@ -206,7 +317,7 @@ void Stest(long n) { // computes and prints sum of 1/p for p <= n
     total = 0;
     for (;;) {
         p = P.next();
-        t = p; total += recip(t); // ###
+        total += Wrecip::leaf(p);
         R.sift(p);
         if (p == P.max()) break;
     }
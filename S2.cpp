@@ -3,15 +3,17 @@
 
 #include "utility.h"
 #include "Primelist.h"
+#include "weight.h"
+#include <vector>
+#include <queue>
+#include <algorithm>
 
 using namespace std;
-using namespace NTL;
 
 
 void sieve(long long newleft, Bitvector &B, ftype &qf_left, long long &lft, long long &rt, Primelist &P, long &pos)
 {
-    if (DEBUG_S2)
-        cerr << "\nSieving...\n";
+    LOG(S2, TRACE) << "Sieving from " << newleft;
     pos=0;
     lft=newleft;
     qf_left=to_ftype(lft);
@@ -22,17 +24,16 @@ void sieve(long long newleft, Bitvector &B, ftype &qf_left, long long &lft, long
     {
         long p=P[i];
         long long first=(lft%p==0)?lft:lft+p-lft%p;
-        for(long long q=first-lft; q<=rt-lft; q+=p)
-            B.clear(q);
+        B.clear(first-lft, rt-lft+1, p);
     }
 }
 
 ftype nextprime(Bitvector &B, ftype &qf_left, long long &lft, long long &rt, Primelist &P, long &pos, ftype &sqrtx)
 {
-    if(rt==0) { sieve(to_long(floor(sqrtx))+1, B, qf_left, lft, rt, P, pos); }
+    if(rt==0) { sieve(ftoll(floor(sqrtx))+1, B, qf_left, lft, rt, P, pos); }
     else if(pos>=B.length()) sieve(rt+1, B, qf_left, lft, rt, P, pos);
 
-    while(pos<B.length() && !B[pos]) pos++;
+    pos=B.find_next_set(pos);
 
     if(pos>=B.length()) return nextprime(B, qf_left, lft, rt, P, pos, sqrtx);
     pos++;
@@ -40,31 +41,25 @@ ftype nextprime(Bitvector &B, ftype &qf_left, long long &lft, long long &rt, Pri
 }
 
 // Returns the contribution of sum 1/p p <= largest prime less than x^(1/3) minus S2 minus 1
-ftype sum1p_and_s2_m1(long long input) {
+ftype sum1p_and_s2_m1(lll input) {
+    PERF_REGION("S2");
     Bitvector B;
     long long lft, rt=0;
     ftype qf_left;
     long pos=0;
-    ftype x; ftype cuberootx; ftype sqrtx;
+    ftype sqrtx;
     Primelist P;
 
-    cuberootx = to_ftype(exp(log(input)/3));
-    ftype::SetOutputPrecision(30);
+    set_output_precision(30);
 
-    x = cuberootx * cuberootx * cuberootx;
-    if (DEBUG_S2) {
-        cerr << "x = " << x << endl;
-        cerr << "cube root = " << cuberootx << endl;
-    }
-    sqrtx = sqrt(x);
-    if (DEBUG_S2)
-        cerr << "sqrt = " << sqrtx << endl;
+    long long cfloor = icbrt(input), maxp = isqrt(input);   // exact, so x/p is too
+    sqrtx = to_ftype(maxp);
+    LOG(S2, DEBUG) << "x = " << input << ", cube root = " << cfloor << ", sqrt = " << maxp;
 
-    long maxp = to_long(floor(sqrtx));
     P.find(maxp);
     if(!P) { cerr << "Error: unable to allocate space.\n"; return to_ftype(0); }
 
-    B.setsize(to_long(floor(cuberootx)));
+    B.setsize(cfloor);
 
     // code to test nextprime()
     //long long p;
@@ -77,47 +72,239 @@ ftype sum1p_and_s2_m1(long long input) {
     long i;
 
     sum1p=0;
-    for(i=0; i < P.length() && P[i] <= floor(cuberootx); i++) sum1p += 1/to_ftype(P[i]);
+    for(i=0; i < P.length() && P[i] <= cfloor; i++) sum1p += 1/to_ftype(P[i]);
     long a=i-1;
-    if (DEBUG_S2) {
-        cerr << "a=" << a << " P[a]=" << P[a] << endl;
-        cerr << "sum 1/p up to p_a = " << sum1p << endl;
-        cerr << "log log pa + B = " << to_double(log(log(to_ftype(P[a])))
-                +to_ftype(0.26149)) << endl << endl;
-    }
+    LOG(S2, DEBUG) << "a=" << a << " P[a]=" << P[a];
+    LOG(S2, DEBUG) << "sum 1/p up to p_a = " << sum1p;
+    LOG(S2, DEBUG) << "log log pa + B = " << ftod(log(log(to_ftype(P[a])))
+            +to_ftype(0.26149));
 
     sum1=0;
     sum2=0;
     long qpos=P.length()-1;
     ftype q;
     q=nextprime(B, qf_left, lft, rt, P, pos, sqrtx); // smallest prime >= sqrtx
-    if (DEBUG_S2)
-        cerr << "First prime >= sqrtx : " << q << endl;
+    LOG(S2, DEBUG) << "First prime >= sqrtx : " << q;
 
+    Progress &pr = Progress::start("S2", "prime", NULL);
+    long nsweep = P.length()-1-a;
     for( i=P.length()-1; i>a; i--)
     {
+        if (((P.length()-1-i) & 0xffff) == 0) pr.update((double)(P.length()-1-i)/nsweep, P.length()-1-i, nsweep);
         ftype p;
         p=to_ftype(P[i]);
         
-        if (DEBUG_S2)
-            cerr << "p=" << p << endl;
+        LOG(S2, TRACE) << "p=" << p;
         // going down from sqrtx:
         sum1 += 1/p;
 
         // going up from sqrtx:
-        while(q<=x/p) { sum2+=1/q; q=nextprime(B, qf_left, lft, rt, P, pos, sqrtx); }
+        ftype xp = to_ftype(xdiv(input, P[i]));
+        while(q<=xp) { sum2+=1/q; q=nextprime(B, qf_left, lft, rt, P, pos, sqrtx); }
 
         sum += (sum1+sum2)/p;
     }
-    if (DEBUG_S2) {
-        cerr << "sum1=" << sum1 << endl;
-        cerr << "sum2=" << sum2 << endl;
-        cerr << "sum1+sum2=" << sum1+sum2 << endl;
-        cerr << "log log x/p_a - log log p_a ="
-            << log(log(x/to_ftype(P[a]))) - log(log(to_ftype(P[a]))) 
-            << endl;
-        cerr << "S2=" << sum << endl;
-        cerr << "-1-S2+(sum 1/p up to p_a) = " << -1-sum+sum1p << endl;
-    }
+    pr.finish();
+    LOG(S2, DEBUG) << "sum1=" << sum1 << ", sum2=" << sum2 << ", sum1+sum2=" << sum1+sum2;
+    LOG(S2, DEBUG) << "log log x/p_a - log log p_a ="
+        << log(log(to_ftype(input)/to_ftype(P[a]))) - log(log(to_ftype(P[a])));
+    LOG(S2, DEBUG) << "S2=" << sum;
+    LOG(S2, DEBUG) << "-1-S2+(sum 1/p up to p_a) = " << -1-sum+sum1p;
     return -1-sum+sum1p;
 }
+
+// Batched version of sum1p_and_s2_m1, for every x in xs (sorted, increasing).
+// With F(t) = sum 1/q for primes q <= t, the loop above adds up
+//    S2 = sum over p_a < p <= sqrt x of (F(x/p) - F(p) + 1/p)/p,
+// so one sweep over the primes up to the largest x/p_a answers every
+// target: F(x/p) is a query at t = x/p, and the F(p) terms are a second
+// running sum G(t) = sum over p <= t of (F(p) - 1/p)/p.  Any multiplicative
+// weight W (weight.h) goes the same way, with f(p) in place of 1/p.
+
+struct S2_query {
+    long long t;      // evaluate F at t
+    int j;            // target
+    long long p;      // add F(t)/p to S2; p == 0 for the G and sum1p queries
+    int kind;         // S2_F, S2_GLO, S2_GHI or S2_SUM1P
+};
+
+#define S2_F     0    // S2 += F(t)/p
+#define S2_GLO   1    // S2 += G(t)
+#define S2_GHI   2    // S2 -= G(t)
+#define S2_SUM1P 3    // sum1p = F(t)
+
+bool operator<(const S2_query &a, const S2_query &b) { return a.t < b.t; }
+bool operator>(const S2_query &a, const S2_query &b) { return a.t > b.t; }
+
+template <class W>
+void s2_w(const vector<lll> &xs, vector<typename W::value> &result)
+{
+    static_assert(W::multiplicative, "S2 needs a multiplicative weight");
+    typedef typename W::value value;
+    PERF_REGION("S2");
+    long ntarget = xs.size();
+    result.assign(ntarget, W::zero());
+    if (ntarget == 0) return;
+
+    vector<long long> cfloor(ntarget), maxp(ntarget);
+    long j;
+    for (j=0; j<ntarget; j++) {   // exact roots, as phi_s and phi_o use
+        cfloor[j] = icbrt(xs[j]);
+        maxp[j] = isqrt(xs[j]);
+    }
+
+    Primelist P;
+    P.find(maxp[ntarget-1]);
+    if(!P) { cerr << "Error: unable to allocate space.\n"; return; }
+
+    vector<S2_query> Q;
+    for (j=0; j<ntarget; j++) {
+        S2_query s = { cfloor[j], (int)j, 0, S2_SUM1P };
+        Q.push_back(s);
+        S2_query g1 = { maxp[j], (int)j, 0, S2_GHI };
+        S2_query g0 = { cfloor[j], (int)j, 0, S2_GLO };
+        Q.push_back(g1); Q.push_back(g0);
+        for (long i=0; i<P.length() && P[i]<=maxp[j]; i++) if (P[i] > cfloor[j]) {
+            S2_query f = { xdiv(xs[j], P[i]), (int)j, (long long)P[i], S2_F };
+            Q.push_back(f);
+        }
+    }
+    sort(Q.begin(), Q.end());
+    PERF_REGION("S2 sweep");
+    Progress &pr = Progress::start("S2", "query", NULL);
+
+    vector<value> S2(ntarget, W::zero());
+    value F, G;
+    F = W::zero(); G = W::zero();
+    size_t qi = 0;
+
+    // answers the queries with t < pr, then adds pr to F and G
+#define S2_STEP(pr) { \
+        while (qi < Q.size() && Q[qi].t < (pr)) { \
+            const S2_query &w = Q[qi++]; \
+            if (w.kind == S2_F) S2[w.j] += W::scale(F, w.p); \
+            else if (w.kind == S2_GLO) S2[w.j] += G; \
+            else if (w.kind == S2_GHI) S2[w.j] -= G; \
+            else result[w.j] = F; \
+        } \
+        value r = W::leaf(pr); \
+        F += r; \
+        G += W::scale(F - r, pr); \
+    }
+
+    for (long i=0; i<P.length() && qi<Q.size(); i++) S2_STEP(P[i]);
+
+    Bitvector B;
+    long long lft, rt;
+    ftype qf_left;
+    long pos;
+    B.setsize(max(cfloor[ntarget-1], 2LL));
+    if (qi < Q.size()) sieve(P.max()+1, B, qf_left, lft, rt, P, pos);
+    while (qi < Q.size()) {
+        pos = B.find_next_set(pos);
+        if (pos >= B.length()) { sieve(rt+1, B, qf_left, lft, rt, P, pos); continue; }
+        S2_STEP(lft+pos);
+        pos++;
+        if ((pos & 0xffff) == 0) pr.update((double)qi/Q.size(), qi, Q.size());
+    }
+#undef S2_STEP
+    pr.finish();
+
+    // result holds sum f(p) up to p_a so far
+    for (j=0; j<ntarget; j++) result[j] = result[j] - S2[j] - W::leaf(1);
+}
+
+void sum1p_and_s2_m1(const vector<lll> &xs, vector<ftype> &result)
+{
+    s2_w<Wrecip>(xs, result);
+}
+
+// S2 riding on phi_s.  Every t = x/p of the sweep above is below x^(2/3),
+// inside phi_s's segments, and sqrt of a segment's end is at most about
+// x^(1/3), so phi_s, which has those primes and has already sifted its
+// segment by most of them, can finish the sieve and hand the primes over
+// in increasing order (phi_s_w's fuse argument).  Then S2 has no sieve of
+// its own.  The sums are those of s2_w, but the F queries can't be listed
+// up front: their p run up to sqrt x, past phi_s's primes.  The primes in
+// (x^(1/3), sqrt x] are kept as they go by, and once t passes sqrt x a
+// target walks them down, each p giving the next query at t = x/p.
+//
+//    S2_fused<W> s2(xs);
+//    phi_s_w<W>(xs, special, &s2);
+//    s2.results(rest);      // as s2_w(xs, rest)
+template <class W>
+class S2_fused
+{
+    public:
+        typedef typename W::value value;
+
+        S2_fused(const vector<lll> &xs) : ntarget(xs.size()), cfloor(ntarget), maxp(ntarget),
+                idx(ntarget), x(xs), S2(ntarget, W::zero()), sum1p(ntarget, W::zero()) {
+            static_assert(W::multiplicative, "S2 needs a multiplicative weight");
+            F = W::zero(); G = W::zero();
+            pmin = pmax = 0;
+            for (long j=0; j<ntarget; j++) {   // same roots as s2_w
+                cfloor[j] = icbrt(xs[j]);
+                maxp[j] = isqrt(xs[j]);
+                pmin = j ? min(pmin, cfloor[j]) : cfloor[j];
+                pmax = max(pmax, maxp[j]);
+                push(cfloor[j], j, S2_SUM1P);
+                push(cfloor[j], j, S2_GLO);
+                push(maxp[j], j, S2_GHI);
+            }
+        }
+
+        // the next prime, r; answers the queries with t < r first
+        void step(long long r) {
+            while (!Q.empty() && Q.top().t < r) answer();
+            if (r > pmin && r <= pmax) ps.push_back(r);
+            value v = W::leaf(r);
+            F += v;
+            G += W::scale(F - v, r);
+        }
+
+        bool done() const { return Q.empty(); }
+
+        // all primes below the queries left have been stepped
+        void results(vector<value> &result) {
+            while (!Q.empty()) answer();
+            result.resize(ntarget);
+            for (long j=0; j<ntarget; j++) result[j] = sum1p[j] - S2[j] - W::leaf(1);
+        }
+
+    private:
+        long ntarget;
+        vector<long long> cfloor, maxp;
+        vector<long> idx;           // next p of target j's F queries, in ps
+        vector<lll> x;
+        vector<value> S2, sum1p;
+        vector<long long> ps;       // primes in (min cfloor, max maxp] so far
+        long long pmin, pmax;
+        value F, G;
+        priority_queue<S2_query, vector<S2_query>, greater<S2_query> > Q;
+
+        void push(long long t, long j, int kind, long long p = 0) {
+            S2_query w = { t, (int)j, p, kind };
+            Q.push(w);
+        }
+
+        // queues target j's F query for ps[idx[j]], if it is still above x^(1/3)
+        void next_f(long j) {
+            if (idx[j] < 0 || ps[idx[j]] <= cfloor[j]) return;
+            long long p = ps[idx[j]--];
+            push(xdiv(x[j], p), j, S2_F, p);
+        }
+
+        void answer() {
+            S2_query w = Q.top();
+            Q.pop();
+            if (w.kind == S2_F) { S2[w.j] += W::scale(F, w.p); next_f(w.j); }
+            else if (w.kind == S2_GLO) S2[w.j] += G;
+            else if (w.kind == S2_GHI) {   // every p <= sqrt x is in ps now
+                S2[w.j] -= G;
+                idx[w.j] = (long)(upper_bound(ps.begin(), ps.end(), maxp[w.j]) - ps.begin()) - 1;
+                next_f(w.j);
+            }
+            else sum1p[w.j] = F;
+        }
+};
@@ -0,0 +1,110 @@
+// Big buffers on 2 MB pages, and the peak of what is out
+//
+// The tables that run to hundreds of MB (the easy leaf sums, Mprimetable,
+// the endgame block) are read all over, and with 4 KB pages nearly every
+// access to them misses the TLB.  Arena::make<T>(n) rounds a request of
+// ARENA_HUGE bytes or more up to whole 2 MB pages and maps it from the
+// hugetlbfs pool (MAP_HUGETLB) while that has pages, else maps it plainly
+// and asks for transparent huge pages (MADV_HUGEPAGE).  Smaller requests
+// go to malloc.  Both kinds are counted, so Arena::peak() is the most
+// bytes the tables held at once; Arena::report() prints it with the peak
+// RSS of the process.
+//
+//    value *T = Arena::make<value>(n);
+//    ...
+//    Arena::release(T, n);
+
+#ifndef _ARENA
+#define _ARENA
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+using namespace std;
+
+#define ARENA_PAGE (2UL << 20)
+#define ARENA_HUGE ARENA_PAGE    // smaller requests go to malloc
+
+class Arena
+{
+    public:
+        // n default-initialized T's
+        template <class T>
+        static T *make(size_t n) {
+            T *p = (T *)get(n*sizeof(T));
+            for (size_t i = 0; i < n; i++) new (&p[i]) T;
+            return p;
+        }
+
+        template <class T>
+        static void release(T *p, size_t n) {
+            if (p == NULL) return;
+            for (size_t i = 0; i < n; i++) p[i].~T();
+            put(p, n*sizeof(T));
+        }
+
+        static size_t inuse() { return stats().inuse; }
+        static size_t peak() { return stats().peak; }
+
+        static void report(ostream &os) {
+            struct rusage ru;
+            getrusage(RUSAGE_SELF, &ru);
+            Stats &s = stats();
+            char buf[160];
+            snprintf(buf, sizeof(buf), "memory: tables peaked at %.1f MB (%ld on hugetlb pages, %ld on THP), peak RSS %.1f MB",
+                    s.peak/1e6, (long)s.hugetlb, (long)s.thp, ru.ru_maxrss/1e3);
+            os << buf << endl;
+        }
+
+    private:
+        struct Stats {
+            atomic<size_t> inuse, peak;
+            atomic<long> hugetlb, thp;  // regions mapped each way
+        };
+
+        static Stats &stats() {
+            static Stats *s = new Stats();
+            return *s;
+        }
+
+        static size_t mapped(size_t bytes) { return (bytes + ARENA_PAGE-1) & ~(ARENA_PAGE-1); }
+
+        static void *get(size_t bytes) {
+            Stats &s = stats();
+            void *p;
+            if (bytes < ARENA_HUGE) {
+                p = malloc(bytes ? bytes : 1);
+                if (p == NULL) throw bad_alloc();
+            }
+            else {
+                bytes = mapped(bytes);
+                p = mmap(NULL, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+                if (p != MAP_FAILED) s.hugetlb++;
+                else {
+                    p = mmap(NULL, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+                    if (p == MAP_FAILED) throw bad_alloc();
+                    madvise(p, bytes, MADV_HUGEPAGE);
+                    s.thp++;
+                }
+            }
+            size_t now = s.inuse += bytes, old = s.peak;
+            while (now > old && !s.peak.compare_exchange_weak(old, now)) ;
+            return p;
+        }
+
+        static void put(void *p, size_t bytes) {
+            if (bytes < ARENA_HUGE) free(p);
+            else {
+                bytes = mapped(bytes);
+                munmap(p, bytes);
+            }
+            stats().inuse -= bytes;
+        }
+};
+
+#endif
@@ -0,0 +1,28 @@
+// Batched evaluation of the full sum 1/p for p <= x at many x.
+//
+// Each part shares its work across the targets: phi_s runs the segment
+// sieve of the largest x once and picks every target's special nodes out
+// of it, sum1p_and_s2_m1 answers all targets from one sweep over the
+// primes, and phi_o reuses its Mobius table.  A sweep of nearby x costs
+// little more than the largest one alone.
+
+#include "utility.h"
+#include "special.cpp"
+#include "ordinary.cpp"
+#include "S2.cpp"
+#include <vector>
+
+using namespace std;
+
+// Computes sum 1/p for p <= x for every x in xs (sorted, increasing)
+void fullsum_batch(const vector<lll> &xs, vector<ftype> &total)
+{
+    vector<ftype> special, ordinary, rest;
+    phi_s(xs, special);
+    phi_o(xs, ordinary);
+    sum1p_and_s2_m1(xs, rest);
+
+    total.resize(xs.size());
+    for (size_t j = 0; j < xs.size(); j++)
+        total[j] = special[j] + ordinary[j] + rest[j];
+}
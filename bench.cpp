@@ -0,0 +1,178 @@
+// Micro-benchmarks for the core kernels.
+//
+// Each line of output is one measurement, as CSV:
+//    kernel,param,ops,seconds,ns_per_op
+// so runs on different machines or after kernel changes can be compared
+// by joining on (kernel, param).  "make runbench" appends a run to
+// bench.csv, with a header line naming the host and date.
+//
+// Kernels timed:
+//    RangeArray reset, sift and prefix at each degree phi_s uses, and
+//    sift and the first prefix (which catches up the tree) in lazy mode;
+//    the same for RangeArrayAny (rangearrayany_*), which is what phi_s
+//    runs: the shift/mask RangeArrayT<LB> for each power-of-two degree
+//    Primelist::find (with the prime table cache off)
+//    Primeindex construction, pi and nth queries
+//    Mulist and Spflist construction
+//    endgame block sieve (schofeld_sieve) and byte scan (bytescan)
+//    is_prime throughput near 10^18
+//
+// Usage: bench [quick]   -- quick uses smaller sizes, for a smoke test
+
+#include "utility.h"
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <string>
+
+#include "Primelist.h"
+#include "Primefns.h"
+#include "RangeArray.h"
+#include "endgame.cpp"
+
+using namespace std;
+
+double now() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void report(const char *kernel, long long param, long long ops, double secs) {
+    printf("%s,%lld,%lld,%.6f,%.3f\n", kernel, param, ops, secs, 1e9*secs/(ops ? ops : 1));
+    fflush(stdout);
+}
+
+// degrees used by phi_s, smallest to largest
+const long degrees[] = { 4, 8, 16, 64, 128, 2048, 2097152 };
+
+// RA is RangeArray, the general version, or RangeArrayAny, the shift/mask
+// version for each power-of-two degree that phi_s uses
+template <class RA>
+void bench_rangearray(long size, const string &name) {
+    long long offset = 1000000000000LL;  // a segment of phi_s at x = 10^18
+    Primelist P(100000);
+    unsigned long long r = 12345;
+    for (size_t k = 0; k < sizeof(degrees)/sizeof(degrees[0]); k++) {
+        long d = degrees[k];
+        RA R(offset, size, d);
+
+        double t = now();
+        int reps = 5;
+        for (int i = 0; i < reps; i++) R.reset(offset + 2*i*size);
+        report((name + "_reset").c_str(), d, (long long)reps*size, now()-t);
+
+        long nsift = 0;
+        t = now();
+        for (long i = 1; i < P.length() && P[i] < 20000; i++) { R.sift(P[i]); nsift++; }
+        report((name + "_sift").c_str(), d, nsift, now()-t);
+
+        long nq = 20000000 / d;  // prefix costs O(d) at the leaves
+        if (nq > 200000) nq = 200000;
+        if (nq < 100) nq = 100;
+        ftype s;
+        s = 0;
+        t = now();
+        for (long i = 0; i < nq; i++) {
+            r = r*6364136223846793005ULL + 1442695040888963407ULL;
+            s += R.prefix((long)((r >> 20) % size));
+        }
+        report((name + "_prefix").c_str(), d, nq, now()-t);
+
+        RA Z(offset, size, d, true);
+        nsift = 0;
+        t = now();
+        for (long i = 1; i < P.length() && P[i] < 20000; i++) { Z.sift(P[i]); nsift++; }
+        report((name + "_lazy_sift").c_str(), d, nsift, now()-t);
+        t = now();
+        s += Z.prefix(size/2);
+        report((name + "_lazy_refresh").c_str(), d, 1, now()-t);
+        if (s < 0) cerr << s << endl;  // keep the loop alive
+    }
+}
+
+void bench_primelist(long n) {
+    setenv("PRIMECACHE", "none", 1);   // time the sieve, not the cache
+    double t = now();
+    Primelist P(n);
+    report("primelist_find", n, n, now()-t);
+}
+
+void bench_primeindex(long n) {
+    double t = now();
+    Primeindex I(n);
+    report("primeindex_build", n, n, now()-t);
+
+    long nq = 1000000, s = 0;
+    unsigned long long r = 12345;
+    t = now();
+    for (long i = 0; i < nq; i++) {
+        r = r*6364136223846793005ULL + 1442695040888963407ULL;
+        s += I.pi((long)((r >> 16) % n));
+    }
+    report("primeindex_pi", n, nq, now()-t);
+    long np = I.pi(n);
+    t = now();
+    for (long i = 0; i < nq; i++) {
+        r = r*6364136223846793005ULL + 1442695040888963407ULL;
+        s += I.nth(1 + (long)((r >> 16) % np));
+    }
+    report("primeindex_nth", n, nq, now()-t);
+    if (s == 42) cerr << s << endl;
+}
+
+void bench_primefns(long n) {
+    double t = now();
+    { Mulist M(n); }
+    report("mulist", n, n, now()-t);
+    t = now();
+    { Spflist S(n); }
+    report("spflist", n, n, now()-t);
+}
+
+void bench_endgame(long long lo, long long width) {
+    EG_blocks blocks;
+    long long hi = lo + width;
+    hi -= hi%30;    // the blocks end at hi, which must be 0 mod 30
+    double t = now();
+    schofeld_sieve(blocks, lo, hi);
+    report("endgame_sieve", lo, width, now()-t);
+
+    long long xsize = 60 << 16;   // whole turns of every wheel
+    unsigned char *X = new unsigned char[xsize];
+    unsigned long long r = 1;
+    for (long long i = 0; i < xsize; i++) {  // about 1 prime in 20 flags
+        r = r*6364136223846793005ULL + 1442695040888963407ULL;
+        X[i] = (r >> 56) < 85 ? 255 & ~(1 << ((r >> 40) & 7)) : 255;
+    }
+    int count;
+    long long isum, total = 0;
+    int reps = 20;
+    t = now();
+    for (int i = 0; i < reps; i++) { bytescan<EG_WHEEL>(X, xsize/EG_wheel<EG_WHEEL>::bytes, count, isum); total += isum; }
+    report("endgame_bytescan", xsize, reps*xsize, now()-t);
+    if (total == 42) cerr << total << endl;
+    delete[] X;
+}
+
+void bench_is_prime(long long start, long n) {
+    long found = 0;
+    double t = now();
+    for (long long i = start|1; i < start + 2*n; i += 2) found += is_prime(i);
+    report("is_prime", start, n, now()-t);
+    if (found < 0) cerr << found << endl;
+}
+
+int main(int argc, char *argv[]) {
+    bool quick = argc > 1 && !strcmp(argv[1], "quick");
+    long scale = quick ? 10 : 1;
+
+    printf("kernel,param,ops,seconds,ns_per_op\n");
+    bench_rangearray<RangeArray>(1000000 / scale, "rangearray");
+    bench_rangearray<RangeArrayAny>(1000000 / scale, "rangearrayany");
+    bench_primelist(100000000 / scale);
+    bench_primeindex(1000000000 / scale);
+    bench_primefns(1000000 / scale);
+    bench_endgame(1000000000000LL, 100000000 / scale);
+    bench_is_prime(1000000000000000000LL, 1000000 / scale);
+    return 0;
+}
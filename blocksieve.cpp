@@ -6,25 +6,24 @@
 #include <iostream>
 
 using namespace std;
-using namespace NTL;
 
 // Returns the first prime x in which sum 1/p p <= x crosses target
 // Starts at hi and decrements until crossover occurs
-long long find_crossover(ftype s, ftype target, long long lo, long long hi) {
-    quad_float::SetOutputPrecision(40);
-    for (long long p = hi; p >= lo; --p) {
+lll find_crossover(ftype s, ftype target, lll lo, lll hi) {
+    PERF_REGION("find_crossover");
+    set_output_precision(40);
+    for (lll p = hi; p >= lo; --p) {
         if(is_prime(p)) {
-            if (DEBUG_BS)
-                cerr << "Sum 1/p for p <= " << p << ": " << s << endl;
-            s -= 1.0/p;
-            if (s < target) {
-                for (long long p2 = p-1; p2 >= lo; --p2) {
+            LOG(BS, TRACE) << "Sum 1/p for p <= " << p << ": " << s;
+            s -= 1.0/(double)p;
+            if (s < target) {   // p is it; the prime below is only for the log
+                for (lll p2 = p-1; p2 >= lo; --p2) {
                     if (is_prime(p2)) {
-                        if (DEBUG_BS)
-                            cerr << "Sum 1/p for p <= " << p2 << ": " << s << endl;
-                        return p;
+                        LOG(BS, DEBUG) << "Sum 1/p for p <= " << p2 << ": " << s;
+                        break;
                     }
                 }
+                return p;
             }
         }
     }
@@ -1,5 +1,10 @@
 // Computes first prime x where sum 1/p p <= x crosses y, inputted as a command line argument.
 // If preferred, these pieces can be run individually via their respective _main programs.
+// With -plan it only prints the estimated time and memory of each stage
+// (planner.cpp), and with --mem-budget (e.g. 4G) it sizes its tables to
+// fit in that much memory.  A running crossover prints its state and ETA
+// on SIGUSR1.  Tracing is picked with LOGLEVEL (log.h), e.g.
+// LOGLEVEL=eg=debug,bs=trace.
 
 #include "utility.h"
 #include "special.cpp"
@@ -8,8 +13,11 @@
 #include "sinterval.cpp"
 #include "endgame.cpp"
 #include "blocksieve.cpp"
+#include "pipeline.cpp"
+#include "planner.cpp"
 #include <iostream>
 #include <cstdio>
+#include <cstring>
 
 using namespace std;
 
@@ -24,35 +32,70 @@ bool isNumber(char* input) {
 }
 
 void usage(char* name) {
-    printf("Usage: %s y\n", name);
+    printf("Usage: %s y [z0 s0] [-plan] [--mem-budget bytes[K|M|G]]\n", name);
+    printf("  z0 s0: optional known sum s0 of 1/p for p <= z0, to narrow the interval\n");
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 2 || !isNumber(argv[1])) {
+    Progress::watch();
+    bool planonly = false, ok = true;
+    for (;;) {   // options go after the numbers
+        if (argc > 1 && !strcmp(argv[argc-1], "-plan")) { planonly = true; argc--; }
+        else if (argc > 2 && !strcmp(argv[argc-2], "--mem-budget")) {
+            ok = ok && (mem_budget = parse_bytes(argv[argc-1])) > 0;
+            argc -= 2;
+        }
+        else break;
+    }
+    if (!ok || (argc != 2 && argc != 4) || !isNumber(argv[1])
+            || (argc == 4 && (!isNumber(argv[2]) || !isNumber(argv[3])))) {
         usage(argv[0]);
     }
     else {
         ftype y = to_ftype(argv[1]);
 
-        long long crossover;
-        long long xlo = (long long)conv<double>(floor(find_z(y, true)));
-        long long xhi = (long long)conv<double>(ceil(find_z(y, false)));
+        lll crossover;
+        lll xlo, xhi;
+        if (argc == 4)  // anchor: sum 1/p p <= z0 is s0, from an earlier run
+            schoenfeld_interval(y, xlo, xhi, to_lll(argv[2]), to_ftype(argv[3]));
+        else
+            schoenfeld_interval(y, xlo, xhi);
         xhi += (30 - xhi%30);
         cout << "x-: " << xlo << " x+: " << xhi << endl;
+
+        if (planonly || xhi >= PLAN_AUTO || mem_budget > 0) {
+            Plan pl = make_plan(xhi, xlo, xhi, planonly || xhi >= PLAN_AUTO);
+            if (mem_budget > 0) fit_budget(pl, mem_budget);
+            print_plan(pl, planonly ? cout : cerr);
+            if (planonly) return 0;
+            seed_progress(pl);
+        }
         
-        ftype special = phi_s(xhi);
-        cout << "phi_s: " << special << endl;
+        // every stage takes its primes from one cached table up to sqrt(x)
+        Primecache::reserve(isqrt(xhi));
 
-        ftype ordinary = phi_o(xhi);
-        cout << "phi_o: " << ordinary << endl;
+        // The three parts of the sum at x+ are independent, and the endgame
+        // sieve of [x-, x+] only needs their total for its final scan,
+        // so all four run concurrently.
+        ftype special, ordinary, rest;
+        EG_blocks blocks;
+        Stagepool pool;
+        pool.add("phi_s", [&]{ special = phi_s(xhi); });
+        pool.add("endgame sieve", [&]{ schofeld_sieve(blocks, xlo, xhi); });
+        pool.add("S2", [&]{ rest = sum1p_and_s2_m1(xhi); });
+        pool.add("phi_o", [&]{ ordinary = phi_o(xhi); });
+        pool.run();
+        pool.report(cerr);
+        Arena::report(cerr);
 
-        ftype rest = sum1p_and_s2_m1(xhi);
+        cout << "phi_s: " << special << endl;
+        cout << "phi_o: " << ordinary << endl;
         cout << "rest: " << rest << endl;
 
         ftype total = special + ordinary + rest;
         cout << "total: " << total << endl;
 
-        long long block_crossover = schofeld_crossover(total, y, xlo, xhi);
+        lll block_crossover = schofeld_scan(total, y, blocks);
         crossover = find_crossover(total, y, xlo, block_crossover);
      // find_crossover can compute the entire crossover point, but due to software arithmetic is far slower
      //    crossover = find_crossover(total, y, xlo, xhi);
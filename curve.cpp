@@ -0,0 +1,200 @@
+// Dense curve of sum 1/p for p <= x, 0 < x <= X, from one sweep.
+//
+// Sieves [0, X] in blocks with the mod 30 wheel (Rangesieve) and emits
+// the running sum at every grid point: every multiple of the step given,
+// or every block boundary.  Each thread sweeps a chunk of consecutive
+// blocks, one block of bitmap at a time; chunks are handed to a Stagepool
+// a round at a time, so the sweep uses every core, memory stays at one
+// block per thread (plus the grid points of a round), and the output
+// still comes out in order.
+//
+// As in the endgame, most primes are not summed one at a time.  For each
+// 64-bit word of the bitmap (240 integers from a) the byte tables give
+// c = #primes, s1 = sum of i and s2 = sum of i^2 over the primes a+i, and
+//    sum 1/(a+i) = c/a - s1/a^2 + s2/a^3 - ...
+// The first omitted term is below c 240^3/a^4, which adds up to less than
+// 10^-16 over the whole sweep once a >= CV_EXACT; below that, and in the
+// word holding a grid point, every 1/p is summed exactly.  Word terms
+// are added in double with compensation and folded into ftype at every
+// grid point, so the curve is good to about 1e-16.
+//
+// Output is CSV lines "x,sum", or with -b binary records
+//    long long x; double hi, lo;    (sum = hi + lo)
+//
+// Usage: curve X [-g step] [-b] [-t threads]
+
+#include "utility.h"
+#include "Primelist.h"
+#include "pipeline.cpp"
+#include <iostream>
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+
+#define CV_BLOCKBYTES 262144       // bytes of bitmap per block (7864320 integers)
+#define CV_CHUNK 64                // blocks per chunk
+#define CV_EXACT 16777216LL        // sum 1/p exactly below this
+
+int H[256], B1[256], B2[256];  // # of primes in a byte, sum of r, sum of r^2
+
+void CVinit() {
+    for (int c = 0; c < 256; c++) {
+        H[c] = B1[c] = B2[c] = 0;
+        for (int k = 0; k < 8; k++) if (c & (1 << k)) {
+            H[c]++; B1[c] += PL_res[k]; B2[c] += PL_res[k]*PL_res[k];
+        }
+    }
+}
+
+// A sum in double with Neumaier's compensation
+struct CV_acc {
+    double s, c;
+    void clear() { s = 0; c = 0; }
+    void add(double t) {
+        double u = s + t;
+        if (fabs(s) >= fabs(t)) c += (s - u) + t;
+        else c += (t - u) + s;
+        s = u;
+    }
+};
+
+struct CV_chunk {
+    long long lo, hi;             // covers [lo, hi)
+    vector<long long> grid;       // grid points in (lo, hi]
+    vector<ftype> partial;        // sum 1/p for lo <= p <= grid point
+    ftype total;                  // sum 1/p for lo <= p < hi
+};
+
+// Sums the primes in one chunk, up to each of its grid points
+void CV_sweep(CV_chunk &blk, long long step, const Primelist &P)
+{
+    vector<unsigned long long> W(CV_BLOCKBYTES/8, 0);
+    unsigned char *x = (unsigned char *)&W[0];
+    Rangesieve R(P, blk.lo, blk.hi);
+
+    ftype run = to_ftype(0);
+    CV_acc acc;
+    acc.clear();
+
+    long long g = (blk.lo/step + 1)*step;   // next grid point
+    if (blk.lo == 0)   // 2, 3 and 5 aren't in the bitmap
+        for (long long p = 2; p <= 5; p++) if (p != 4) {
+            while (g < p) {
+                blk.grid.push_back(g); blk.partial.push_back(run);
+                g += step;
+            }
+            run += 1/to_ftype(p);
+        }
+    for (long long lo = blk.lo; lo < blk.hi; lo += 30LL*CV_BLOCKBYTES) {
+        long nbytes = min(blk.hi - lo, 30LL*CV_BLOCKBYTES)/30;
+        if (nbytes < CV_BLOCKBYTES) memset(x, 0, CV_BLOCKBYTES);   // whole last word
+        R.next(x, nbytes);
+        for (long w = 0; 8*w < nbytes; w++) {
+            long long a = lo + 240LL*w;
+            long long end = min(a + 240, blk.hi);
+            if (a < CV_EXACT || g < end) {   // one prime at a time
+                for (long j = 8*w; j < 8*w+8 && j < nbytes; j++)
+                    for (unsigned int t = x[j]; t; t &= t-1) {
+                        long long p = lo + 30LL*j + PL_res[__builtin_ctz(t)];
+                        while (g < p) {   // grid points before p
+                            run += to_ftype(acc.s) + to_ftype(acc.c);
+                            acc.clear();
+                            blk.grid.push_back(g); blk.partial.push_back(run);
+                            g += step;
+                        }
+                        if (p < CV_EXACT) run += 1/to_ftype(p);
+                        else acc.add(1.0/p);
+                    }
+                while (g < end) {
+                    run += to_ftype(acc.s) + to_ftype(acc.c);
+                    acc.clear();
+                    blk.grid.push_back(g); blk.partial.push_back(run);
+                    g += step;
+                }
+                continue;
+            }
+            long long c = 0, s1 = 0, s2 = 0;
+            unsigned long long v = W[w];
+            for (int k = 0; k < 8; k++, v >>= 8) {
+                int b = v & 0xff;
+                long long o = 30*k;
+                c += H[b];
+                s1 += o*H[b] + B1[b];
+                s2 += o*o*H[b] + 2*o*B1[b] + B2[b];
+            }
+            if (c == 0) continue;
+            double r = 1.0/a;
+            acc.add(r*(c - r*(s1 - r*s2)));
+        }
+    }
+    run += to_ftype(acc.s) + to_ftype(acc.c);
+    blk.total = run;
+    if (g == blk.hi) {   // the grid point at the end of the block
+        blk.grid.push_back(g); blk.partial.push_back(run);
+    }
+}
+
+void usage(char *name) {
+    printf("Usage: %s X [-g step] [-b] [-t threads]\n", name);
+    printf("  sum 1/p for p <= x at every multiple of step up to X\n");
+    printf("  (default: every %d), as CSV or, with -b, binary records\n", 30*CV_BLOCKBYTES);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || atoll(argv[1]) < 30) { usage(argv[0]); return 1; }
+    long long X = atoll(argv[1]);
+    long long step = 30LL*CV_BLOCKBYTES;
+    bool binary = false;
+    unsigned nthreads = 0;
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "-g") && i+1 < argc) step = atoll(argv[++i]);
+        else if (!strcmp(argv[i], "-b")) binary = true;
+        else if (!strcmp(argv[i], "-t") && i+1 < argc) nthreads = atoi(argv[++i]);
+        else { usage(argv[0]); return 1; }
+    }
+    if (step < 1) { usage(argv[0]); return 1; }
+    if (nthreads == 0) nthreads = thread::hardware_concurrency();
+    if (nthreads == 0) nthreads = 1;
+
+    CVinit();
+    set_output_precision(20);
+    Primecache::reserve((long)sqrt((double)X+30)+1);
+    Primelist P((long)sqrt((double)X+30)+1);
+
+    // chunks end on multiples of 30, and the last one covers X
+    long long chunklen = 30LL*CV_BLOCKBYTES*CV_CHUNK;
+    long long nchunks = X/chunklen + 1;
+    ftype total = to_ftype(0);
+    for (long long k0 = 0; k0 < nchunks; k0 += nthreads) {
+        long long k1 = min(k0 + (long long)nthreads, nchunks);
+        vector<CV_chunk> blks(k1 - k0);
+        Stagepool pool;
+        for (long long k = k0; k < k1; k++) {
+            CV_chunk &blk = blks[k-k0];
+            blk.lo = k*chunklen;
+            blk.hi = min(blk.lo + chunklen, (X/30+1)*30);
+            CV_chunk *bp = &blk;
+            pool.add("chunk", [bp, step, &P]{ CV_sweep(*bp, step, P); });
+        }
+        pool.run(nthreads);
+
+        for (size_t i = 0; i < blks.size(); i++) {
+            CV_chunk &blk = blks[i];
+            for (size_t j = 0; j < blk.grid.size() && blk.grid[j] <= X; j++) {
+                ftype s = total + blk.partial[j];
+                if (binary) {
+                    double hi = ftod(s), lo = ftod(s - to_ftype(hi));
+                    fwrite(&blk.grid[j], sizeof(long long), 1, stdout);
+                    fwrite(&hi, sizeof(double), 1, stdout);
+                    fwrite(&lo, sizeof(double), 1, stdout);
+                }
+                else cout << blk.grid[j] << "," << s << "\n";
+            }
+            total += blk.total;
+        }
+        if (!binary) cout << flush;
+    }
+
+    return 0;
+}
@@ -0,0 +1,263 @@
+// Double-double arithmetic
+//
+// A dd is an unevaluated sum hi + lo of two doubles with |lo| <= ulp(hi)/2,
+// which gives a 106-bit significand (about 32 decimal digits), the same as
+// NTL's quad_float.  Unlike quad_float everything here is inline and the
+// exact products come from fma(), so the compiler can keep sums in
+// registers instead of calling into the library for every add.
+//
+// Accuracy (u = 2^-53, bounds on the relative error of one operation):
+//    dd + dd     3u^2  (~ 3.7e-32)      "accurate" addition
+//    dd * dd     2u^2  (~ 2.5e-32)      with fma
+//    dd / dd    15u^2  (~ 1.9e-31)
+//    sqrt, exp, log    a few ulps of the 106-bit result (~ 1e-31)
+// Conversions from long long are exact; from strings, good to ~1e-31.
+// There is no extended exponent range: numbers are limited to that of double.
+//
+// Build with -mfma (or -march=native) so that fma() is a single instruction.
+
+#ifndef _DDOUBLE
+#define _DDOUBLE
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+class dd
+{
+    public:
+        double hi, lo;
+
+        static long oprec;  // digits printed by operator<<
+        static void SetOutputPrecision(long p) { oprec = p; }
+
+        dd() : hi(0), lo(0) {}
+        dd(double h, double l) : hi(h), lo(l) {}
+        dd(double x) : hi(x), lo(0) {}
+        dd(int x) : hi(x), lo(0) {}
+        dd(unsigned int x) : hi(x), lo(0) {}
+        dd(long long x) {   // exact: split into 32-bit halves
+            double h = (double)(x & ~0xffffffffLL), l = (double)(x & 0xffffffffLL);
+            hi = h + l; lo = l - (hi - h);
+        }
+        dd(long x) { *this = dd((long long)x); }
+        dd(unsigned long x) { *this = dd((long long)x); }
+        dd(unsigned long long x) { *this = dd((long long)x); }
+
+        inline dd & operator+=(const dd &b);
+        inline dd & operator-=(const dd &b);
+        inline dd & operator*=(const dd &b);
+        inline dd & operator/=(const dd &b);
+};
+
+long dd::oprec = 10;
+
+// error-free transformations
+
+inline dd dd_quick_two_sum(double a, double b) {   // needs |a| >= |b|
+    double s = a + b;
+    return dd(s, b - (s - a));
+}
+
+inline dd dd_two_sum(double a, double b) {
+    double s = a + b;
+    double bb = s - a;
+    return dd(s, (a - (s - bb)) + (b - bb));
+}
+
+inline dd dd_two_prod(double a, double b) {
+    double p = a * b;
+    return dd(p, fma(a, b, -p));
+}
+
+// arithmetic
+
+inline dd operator+(const dd &a, const dd &b) {
+    dd s = dd_two_sum(a.hi, b.hi);
+    dd t = dd_two_sum(a.lo, b.lo);
+    s.lo += t.hi;
+    s = dd_quick_two_sum(s.hi, s.lo);
+    s.lo += t.lo;
+    return dd_quick_two_sum(s.hi, s.lo);
+}
+
+inline dd operator+(const dd &a, double b) {
+    dd s = dd_two_sum(a.hi, b);
+    s.lo += a.lo;
+    return dd_quick_two_sum(s.hi, s.lo);
+}
+
+inline dd operator+(double a, const dd &b) { return b + a; }
+
+inline dd operator-(const dd &a) { return dd(-a.hi, -a.lo); }
+inline dd operator-(const dd &a, const dd &b) { return a + (-b); }
+inline dd operator-(const dd &a, double b) { return a + (-b); }
+inline dd operator-(double a, const dd &b) { return (-b) + a; }
+
+inline dd operator*(const dd &a, const dd &b) {
+    dd p = dd_two_prod(a.hi, b.hi);
+    p.lo += a.hi * b.lo + a.lo * b.hi;
+    return dd_quick_two_sum(p.hi, p.lo);
+}
+
+inline dd operator*(const dd &a, double b) {
+    dd p = dd_two_prod(a.hi, b);
+    p.lo += a.lo * b;
+    return dd_quick_two_sum(p.hi, p.lo);
+}
+
+inline dd operator*(double a, const dd &b) { return b * a; }
+
+inline dd operator/(const dd &a, const dd &b) {
+    double q1 = a.hi / b.hi;
+    dd r = a - b * q1;
+    double q2 = r.hi / b.hi;
+    r = r - b * q2;
+    double q3 = r.hi / b.hi;
+    return dd_quick_two_sum(q1, q2) + q3;
+}
+
+inline dd operator/(const dd &a, double b) { return a / dd(b); }
+inline dd operator/(double a, const dd &b) { return dd(a) / b; }
+
+inline dd & dd::operator+=(const dd &b) { return *this = *this + b; }
+inline dd & dd::operator-=(const dd &b) { return *this = *this - b; }
+inline dd & dd::operator*=(const dd &b) { return *this = *this * b; }
+inline dd & dd::operator/=(const dd &b) { return *this = *this / b; }
+
+// comparisons
+
+inline bool operator==(const dd &a, const dd &b) { return a.hi == b.hi && a.lo == b.lo; }
+inline bool operator!=(const dd &a, const dd &b) { return !(a == b); }
+inline bool operator<(const dd &a, const dd &b) { return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo); }
+inline bool operator>(const dd &a, const dd &b) { return b < a; }
+inline bool operator<=(const dd &a, const dd &b) { return !(b < a); }
+inline bool operator>=(const dd &a, const dd &b) { return !(a < b); }
+
+// functions
+
+inline dd fabs(const dd &a) { return a.hi < 0 ? -a : a; }
+
+inline dd floor(const dd &a) {
+    double h = std::floor(a.hi);
+    if (h != a.hi) return dd(h, 0);
+    return dd_quick_two_sum(h, std::floor(a.lo));
+}
+
+inline dd ceil(const dd &a) {
+    double h = std::ceil(a.hi);
+    if (h != a.hi) return dd(h, 0);
+    return dd_quick_two_sum(h, std::ceil(a.lo));
+}
+
+inline dd sqrt(const dd &a) {   // one Newton step from the double root
+    if (a.hi <= 0) return dd(0);
+    double x = std::sqrt(a.hi);
+    dd xx = dd_two_prod(x, x);
+    return dd_two_sum(x, ((a - xx).hi) * (0.5 / x)) ;
+}
+
+const dd dd_ln2(6.931471805599452862e-01, 2.319046813846299558e-17);
+
+inline dd exp(const dd &a) {
+    // a = k ln 2 + r, |r| <= ln2/2; exp(r) = exp(r/1024)^1024
+    if (a.hi > 709.0) return dd(HUGE_VAL);
+    if (a.hi < -745.0) return dd(0);
+    double k = std::floor(a.hi / dd_ln2.hi + 0.5);
+    dd r = (a - dd_ln2 * k) * (1.0/1024);
+    dd s = r, term = r;   // s = exp(r) - 1, by Taylor series
+    for (int i = 2; i < 20; i++) {
+        term = term * r / (double)i;
+        s = s + term;
+        if (std::fabs(term.hi) < 1e-33 * std::fabs(s.hi)) break;
+    }
+    for (int i = 0; i < 10; i++) s = s * (s + 2.0);    // (1+s)^2 - 1
+    s = s + 1.0;
+    return dd(ldexp(s.hi, (int)k), ldexp(s.lo, (int)k));
+}
+
+inline dd log(const dd &a) {    // one Newton step: y + a exp(-y) - 1
+    if (a.hi <= 0) return dd(-HUGE_VAL);
+    dd y = std::log(a.hi);
+    return y + a * exp(-y) - 1.0;
+}
+
+// conversions
+
+inline long to_long(const dd &a) {   // truncates like (long)
+    dd f = a.hi < 0 ? ceil(a) : floor(a);
+    return (long)f.hi + (long)f.lo;
+}
+
+inline double to_double(const dd &a) { return a.hi + a.lo; }
+
+inline dd to_dd(const char *s) {     // [-]ddd[.ddd][e[+-]dd]
+    dd r = 0;
+    int neg = 0, scale = 0, point = 0;
+    while (*s == ' ') s++;
+    if (*s == '-' || *s == '+') neg = (*s++ == '-');
+    for (; *s; s++) {
+        if (*s == '.') point = 1;
+        else if (*s >= '0' && *s <= '9') { r = r * 10.0 + (double)(*s - '0'); scale -= point; }
+        else break;
+    }
+    if (*s == 'e' || *s == 'E') scale += atoi(s+1);
+    dd p = 1, ten = 10;
+    for (int e = scale < 0 ? -scale : scale; e; e >>= 1, ten = ten * ten)
+        if (e & 1) p = p * ten;
+    r = scale < 0 ? r / p : r * p;
+    return neg ? -r : r;
+}
+
+inline std::ostream & operator<<(std::ostream &os, const dd &a) {
+    // prints oprec significant digits, in the style of quad_float
+    char buf[128];
+    long n = dd::oprec < 1 ? 1 : (dd::oprec > 32 ? 32 : dd::oprec);
+    if (a.hi == 0 || !std::isfinite(a.hi)) { os << a.hi; return os; }
+    dd v = fabs(a);
+    int e = (int)std::floor(std::log10(v.hi));
+    dd p = 1, ten = 10;
+    for (int k = e < 0 ? -e : e; k; k >>= 1, ten = ten * ten)
+        if (k & 1) p = p * ten;
+    v = e < 0 ? v * p : v / p;       // now 1 <= v < 10, up to rounding
+    if (v.hi >= 10) { v = v / 10.0; e++; }
+    if (v.hi < 1) { v = v * 10.0; e--; }
+    int digits[40];
+    for (long i = 0; i < n + 1; i++) {
+        int d = (int)std::floor(v.hi);
+        if (d > 9) d = 9;
+        if (d < 0) d = 0;
+        digits[i] = d;
+        v = (v - (double)d) * 10.0;
+    }
+    if (digits[n] >= 5) {          // round
+        long i = n - 1;
+        while (i >= 0 && ++digits[i] == 10) digits[i--] = 0;
+        if (i < 0) { digits[0] = 1; e++; }
+    }
+    int len = 0;
+    if (a.hi < 0) buf[len++] = '-';
+    if (e >= 0 && e < n) {          // d.ddd
+        for (long i = 0; i < n; i++) {
+            buf[len++] = '0' + digits[i];
+            if (i == e && i < n - 1) buf[len++] = '.';
+        }
+    }
+    else if (e < 0 && e > -6) {     // 0.000ddd
+        buf[len++] = '0'; buf[len++] = '.';
+        for (int i = -1; i > e; i--) buf[len++] = '0';
+        for (long i = 0; i < n; i++) buf[len++] = '0' + digits[i];
+    }
+    else {                          // 0.ddde+x, like quad_float
+        buf[len++] = '0'; buf[len++] = '.';
+        for (long i = 0; i < n; i++) buf[len++] = '0' + digits[i];
+        len += sprintf(buf + len, "e%d", e + 1);
+    }
+    buf[len] = 0;
+    os << buf;
+    return os;
+}
+
+#endif
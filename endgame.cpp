@@ -1,10 +1,10 @@
 // For approximating sum_{1/p} in blocks
 //
 // Uses segmented sieve of Eratosthenes. We only care about numbers
-// prime to 30, flags for which will fit in a byte.  (Note phi(30) = 8.)
-// We skip over even multiples of 30 and test the others mod 30.
-// At the end each array reference is a cache miss anyway so we can
-// afford to do this test with a table look-up.
+// prime to the wheel modulus M (EG_WHEEL: 30, 210 or 2310), and only
+// cross out the multiples p q with q prime to M, stepping q around the
+// wheel.  At the end each array reference is a cache miss anyway so we
+// can afford to find the bit with a table look-up.
 //
 // Instead of accumulating 1/p, we do a "byte scan" at the end to
 // recover # of primes in the interval, and the total of
@@ -27,86 +27,122 @@
 #include "Primelist.h"
 
 using namespace std;
-using namespace NTL;
 
-void HBinit(int *H, int *B)       // constructor for these tables
-{ int c, s;
-    unsigned char t;
-    for (c=0;c<256;c++) {
-        H[c] = 0; B[c] = 0;
-        if (!(c&01)) {H[c]++;  B[c] += 1;}
-        if (!(c&02)) {H[c]++; B[c] += 7;}
-        if (!(c&04)) {H[c]++; B[c] += 11;}
-        if (!(c&010)) {H[c]++; B[c] += 13;}
-        if (!(c&020)) {H[c]++; B[c] += 17;}
-        if (!(c&040)) {H[c]++; B[c] += 19;}
-        if (!(c&0100)) {H[c]++; B[c] += 23;}
-        if (!(c&0200)) {H[c]++; B[c] += 29;}
-    }
-    if (DEBUG_EG) {
-       for (c=0;c<256;c++) cerr << H[c] << " "; cerr << endl << endl;
-       for (c=0;c<256;c++) cerr << B[c] << " "; cerr << endl << endl;
+long long eg_xint = 0;    // block size; 0: (hi - lo)^(3/4).  The planner sets it to fit a memory budget
+
+// The wheel of the block sieve, modulus M = 30, 210 or 2310.  Only the
+// phi(M) residues prime to M get a bit (8, 48 or 480), so a turn of M
+// integers takes phi(M)/8 bytes (1, 6 or 60) and the primes dividing M
+// are never sieved.  Bit k of a turn is residue res[k]; a set bit is
+// crossed out.  Every table is built at compile time.
+constexpr int EG_gcd(int a, int b) { return b ? EG_gcd(b, a%b) : a; }
+constexpr int EG_phi(int m) { int n = 0; for (int r = 1; r < m; r++) n += EG_gcd(r, m) == 1; return n; }
+
+template <int M>
+struct EG_wheel
+{
+    static constexpr int n = EG_phi(M);     // residues prime to M
+    static constexpr int bytes = n/8;       // per turn
+    int res[n];               // increasing
+    int gap[n];               // to the next residue, around the wheel
+    short bit[M];             // k with res[k] = r, or -1
+    short inv[M];             // 1/r mod M, for r prime to M
+    short skip[M];            // from r to the next residue prime to M
+    int bsum[bytes][256];     // sum of res over the clear bits of byte b of a turn
+    int firstp;               // smallest prime not dividing M
+
+    constexpr EG_wheel() : res(), gap(), bit(), inv(), skip(), bsum(), firstp(0) {
+        int k = 0;
+        for (int r = 0; r < M; r++) {
+            bit[r] = -1;
+            if (EG_gcd(r, M) == 1) { bit[r] = k; res[k++] = r; }
+        }
+        for (k = 0; k < n; k++)
+            for (int s = 0; s < n; s++)
+                if (res[k]*res[s] % M == 1) inv[res[k]] = res[s];
+        for (int r = 0; r < M; r++)
+            while (EG_gcd((r + skip[r]) % M, M) != 1) skip[r]++;
+        for (k = 0; k < n; k++) gap[k] = (k+1 < n ? res[k+1] : M + res[0]) - res[k];
+        for (int b = 0; b < bytes; b++)
+            for (int c = 0; c < 256; c++)
+                for (int j = 0; j < 8; j++)
+                    if (!(c & (1 << j))) bsum[b][c] += res[8*b+j];
+        firstp = res[1];
     }
-}
+};
+
+template <int M>
+constexpr EG_wheel<M> EG_tables{};
 
-#define WSIZE 30
+#ifndef EG_WHEEL
+#define EG_WHEEL 2310
+#endif
 
-void Winit(int *Wrp, char *Wshft)  // constructor for the wheel
+// Byte scan of a sieved block of nturns turns: number of primes, and the
+// sum of their offsets from the start of the block
+template <int M>
+void bytescan(const unsigned char *Xblok, long long nturns, int &primecount, long long &isum)
 {
-    int i;
-    for (i=0;i<WSIZE;i++) Wrp[i] = 1;
-    for (i=0;i<WSIZE;i+=2) Wrp[i] = 0;
-    for (i=0;i<WSIZE;i+=3) Wrp[i] = 0;
-    for (i=0;i<WSIZE;i+=5) Wrp[i] = 0;
-    Wshft[1] = 1;
-    Wshft[7] = 1 << 1;
-    Wshft[11] = 1 << 2;
-    Wshft[13] = 1 << 3;
-    Wshft[17] = 1 << 4;
-    Wshft[19] = 1 << 5;
-    Wshft[23] = 1 << 6;
-    Wshft[29] = 1 << 7;
+    PERF_REGION("endgame bytescan");
+    const EG_wheel<M> &W = EG_tables<M>;
+    const int nb = EG_wheel<M>::bytes;
+    primecount = 0;
+    isum = 0;
+    for (long long t = 0; t < nturns; t++) {
+        const unsigned char *x = Xblok + nb*t;
+        int h = 8*nb, s = 0;     // a crossed-out byte adds 0 to both
+        for (int b = 0; b < nb; b++) {
+            h -= __builtin_popcount(x[b]);
+            s += W.bsum[b][x[b]];
+        }
+        primecount += h;
+        isum += (M*t)*h + s;
+    }
 }
 
 long long pi_x_upper(long long x) {
     return (long long)ceil((1.25506 * x)/log(x));
 }
 
-// Returns the offset of the block in which the sum crosses the goal value
-// Updates sum according to where the offset left off
-long long schofeld_crossover(ftype &sum, ftype goal, long long lo, long long hi)
-{
-    int Wrp[WSIZE];           // stripped-down size 30 wheel
-    char Wshft[WSIZE];        // mod 30 to bit position encoding
-    Winit(Wrp, Wshft);
+// Per-block statistics from the large sieve of [lo, hi].  Sieving only
+// needs lo and hi, so it can run before the total at hi is known.
+struct EG_blocks {
+    long long xint;                 // size of each block
+    vector<lll> offsetA;            // start of block k (a multiple of 30)
+    vector<lll> firstprimeA;        // first prime in block k
+    vector<long long> countA;       // number of primes in block k
+    vector<long long> isumA;        // sum of (p - offset) over block k
+};
 
-    int H[256], B[256];  // Hamming wt and isum tables for all possible bytes
-    // If the zero bits are at positions c1,..,ck then
-    // H = k and B = c1+...+ck.
-    HBinit(H, B);
+// Sieves [lo, hi] in blocks and records the count/isum statistics.
+// The blocks end at hi, so with M > 30 they needn't start on a turn of
+// the wheel: each is sieved from the turn it starts in, and the flags
+// outside it are crossed out before the scan.
+template <int M = EG_WHEEL>
+void schofeld_sieve(EG_blocks &blocks, lll lo, lll hi)
+{
+    PERF_REGION("endgame sieve");
+    const EG_wheel<M> &W = EG_tables<M>;
+    const int nb = EG_wheel<M>::bytes;
 
-    
-    long long xint = (long long)pow(hi - lo, 3.0/4);     // size of sieving interval in large sieve, should be multiple of 30
+    long long xint = eg_xint > 0 ? eg_xint : (long long)pow((double)(hi - lo), 3.0/4);     // size of sieving interval in large sieve, should be multiple of 30
     xint += (30 - xint%30);                             // best performance is achieved when xint is as large as possible
                                                         // without running out of memory.
-    long long xsize = xint/30;                          // actual size of the data block; must be integral
+    long long xsize = ((xint + M-1)/M + 1)*nb;          // bytes for the turns a block meets
     long long numx = (hi - lo + xint-1) / xint;         // number of intervals to sieve in large sieve
-    long long start = hi - numx*xint;                   // where to start the sieve
+    lll start = hi - numx*xint;                         // where to start the sieve
     
 
-    long long bloksize = max((long long)ceil(pow(hi, 1.0/4)), 5LL);     // size of block for little sieve
-    long long nbloks = max((long long)ceil(pow(hi, 1.0/4)), 5LL);     // number of blocks for little sieve
+    long long bloksize = max((long long)ceil(pow((double)hi, 1.0/4)), 5LL);     // size of block for little sieve
+    long long nbloks = max((long long)ceil(pow((double)hi, 1.0/4)), 5LL);     // number of blocks for little sieve
                                                             // nbloks*bloksize must be >= hi^(1.0/2)
                                                             // value can't be "too small", so take max of it with 5 
     long long pcount = pi_x_upper(nbloks*bloksize);     // should be an upper bound on pi(nbloks*bloksize)
                                                         // note that this should be pi(hi^(1/2))
    
-    if (DEBUG_EG) {
-        cerr << "nbloks: " << nbloks << endl;
-        cerr << "bloksize: " << bloksize << endl; 
-    }
-    unsigned int i;
-    unsigned char *Xblok = new unsigned char[xsize]; // bit vector, re-used
+    LOG(EG, DEBUG) << "nbloks: " << nbloks << ", bloksize: " << bloksize;
+    long long i;              // p - offset%p can pass 2^32 beyond x = 1.8*10^19
+    unsigned char *Xblok = Arena::make<unsigned char>(xsize); // bit vector, re-used
    
     unsigned char *G = new unsigned char[pcount];   // G[0] ... G[g-1] are half-gaps between odd primes
     long g;                    // G[0] = (5-3)/2, G[1] = (7-5)/2, etc.
@@ -114,12 +150,11 @@ long long schofeld_crossover(ftype &sum, ftype goal, long long lo, long long hi)
     char *Sblok = new char[bloksize];  // small segments we sieve to make the prime gaps
 
     Primelist P(bloksize);
-    if (DEBUG_EG)
-        cerr << "P.max(): " << P.max() << endl;
+    LOG(EG, DEBUG) << "P.max(): " << P.max();
     long prevp, newp;
     long j, k;
     long p;
-    long long offset;
+    lll offset;
     
     // statistics for each block
     float fsum;
@@ -127,10 +162,11 @@ long long schofeld_crossover(ftype &sum, ftype goal, long long lo, long long hi)
     long double ldsum;
     ftype qfsum, offinv;
     int primecount;
-    long long firstprime, lastprime, isum;
+    lll firstprime;
+    long long lastprime, isum;
     
     cerr.precision(20);
-    ftype::SetOutputPrecision(30);
+    set_output_precision(30);
     
     // Find all gaps between "small" primes
     
@@ -152,23 +188,20 @@ long long schofeld_crossover(ftype &sum, ftype goal, long long lo, long long hi)
     // We have now found all gaps in block 0 so we can start the little sieve
     // with k=1.  This is only done once so it need not be all that efficient
   
-    if (DEBUG_EG) {
-        cerr << "bloksize*nbloks: " << bloksize*nbloks << endl;
-        cerr << "upper bound on pi(bloksize*nbloks): " << pi_x_upper(bloksize*nbloks) << endl;
-    }
+    LOG(EG, DEBUG) << "bloksize*nbloks: " << bloksize*nbloks
+                   << ", upper bound on pi(bloksize*nbloks): " << pi_x_upper(bloksize*nbloks);
 
     offset = bloksize+1;
     for (k=1;k<nbloks;k++) {    //changed 7/6/15 to '<' rather than '<='
         
-        if (DEBUG_EG)
-            cerr << "little sieve " << k << endl;
+        LOG(EG, TRACE) << "little sieve " << k;
         
         for (i=0;i<bloksize;i++) Sblok[i] = 1;
         
         P.reset();
         for (;;) {
             p = P.next();
-            i = p - offset%p;
+            i = p - xmod(offset, p);
             if (i==p) i=0;  // inelegant but works
             while (i<bloksize) {
                 Sblok[i] = 0;
@@ -191,39 +224,55 @@ long long schofeld_crossover(ftype &sum, ftype goal, long long lo, long long hi)
         offset += bloksize;
     }
    
-    if (DEBUG_EG) { 
-        cerr << "Prime table size: " << g << endl;
-        cerr << "Max prime from table: " << newp << endl;
-    }
+    LOG(EG, DEBUG) << "Prime table size: " << g << ", max prime from table: " << newp;
     // now we sieve blocks of large numbers
     
-    vector<long long> offsetA(numx);
-    vector<long long> firstprimeA(numx);
-    vector<long long> countA(numx);
-    vector<long long> isumA(numx);
+    blocks.xint = xint;
+    vector<lll> &offsetA = blocks.offsetA;
+    vector<lll> &firstprimeA = blocks.firstprimeA;
+    vector<long long> &countA = blocks.countA;
+    vector<long long> &isumA = blocks.isumA;
+    offsetA.assign(numx, 0);
+    firstprimeA.assign(numx, 0);
+    countA.assign(numx, 0);
+    isumA.assign(numx, 0);
 
     offset = start; // this and xsize should be multiples of 30
+    Progress &pr = Progress::start("endgame sieve", "block", "primes");
+    long long nprimes = 0;
     for (k=0;k<numx;k++) {
+        PERF_REGION("endgame block");
         
-        if (offset%30) {
+        if (xmod(offset, 30)) {
             cerr << "bad offset " << offset << endl;
-            cerr << "should be 0 mod 30, but is " << offset%30 << " mod 30" << endl;
+            cerr << "should be 0 mod 30, but is " << xmod(offset, 30) << " mod 30" << endl;
             exit(1);
         }
         
-        for (i=0;i<xsize;i++) Xblok[i] = 0;
-        
-        j = 2; // we skip 2,3,5
+        lll base = offset - xmod(offset, M);              // turn the block starts in
+        long long lead = (long long)(offset - base);
+        long long nturns = (lead + xint + M-1)/M, span = M*nturns;
+        memset(Xblok, 0, nturns*nb);
+
+        // cross out the multiples p q, q prime to M, from max(p^2, base) on
+        j = 2; // G[2] is the gap after 7
         p = 7;
         while (j<=g)  {
-            unsigned long p2;
-            p2 = p<<1;
-            i = p - offset%p;
-            if (i==p) i=0;
-            if (i%2 == 0) i += p;
-            while (i<xint) {
-                if (Wrp[i%30]) Xblok[i/30] |= Wshft[i%30];
-                i += p2;
+            if (p >= W.firstp) {
+                i = p - xmod(base, p);                    // p q - base
+                if (i == p) i = 0;
+                if (base + i < (lll)p*p) i = (long long)((lll)p*p - base);
+                if (i >= span) { p = p + 2*G[j++]; continue; }
+                // base is 0 mod M, so q = (p q) / p = i / p mod M
+                int qm = (i % M)*W.inv[p % M] % M;
+                i += (long long)W.skip[qm]*p;
+                int w = W.bit[(qm + W.skip[qm]) % M];
+                while (i < span) {
+                    int k = W.bit[i%M];
+                    Xblok[i/M*nb + (k>>3)] |= 1 << (k&7);
+                    i += p*W.gap[w];
+                    w = w+1 == W.n ? 0 : w+1;
+                }
             }
             p = p + 2*G[j++];
             
@@ -233,59 +282,53 @@ long long schofeld_crossover(ftype &sum, ftype goal, long long lo, long long hi)
             }
         }
         
-        if (DEBUG_EG) {
-            cerr << endl;
-            cerr << "finished sieving block " << k << endl;
-        }
+        // the flags before the block and past its end
+        auto cross = [&](long long i) {
+            int k = W.bit[i%M];
+            if (k >= 0) Xblok[i/M*nb + (k>>3)] |= 1 << (k&7);
+        };
+        for (i = 0; i < lead; i++) cross(i);
+        for (i = lead + xint; i < span; i++) cross(i);
 
         i=0; // find the first prime in the sieved interval
-        while (Xblok[i] == 255) i++;
-        { int s, t;
-            s = 0;
-            t = Xblok[i];
-            while (t&01) {
-                s++;
-                t = t>>1;
-            }
-            if (s==0) t=1;
-            if (s==1) t=7;
-            if (s==2) t=11;
-            if (s==3) t=13;
-            if (s==4) t=17;
-            if (s==5) t=19;
-            if (s==6) t=23;
-            if (s==7) t=29;
-            firstprime = offset + 30*i + t;
-        }
+        while (i < nturns*nb && Xblok[i] == 255) i++;
+        if (i < nturns*nb)
+            firstprime = base + M*(i/nb) + W.res[8*(i%nb) + __builtin_ctz(~Xblok[i])];
+        else firstprime = 0;
         
-        if (DEBUG_EG)
-            cerr << "offset " << offset << endl;
         offsetA[k] = offset;
-        
-        if (DEBUG_EG)
-            cerr << "first prime at " << firstprime << endl;
         firstprimeA[k] = firstprime;
 
-        primecount = 0; // get coeffs for sum of 1/p
-        isum = 0;
-        for (i=0;i<xsize;i++) {
-            if (Xblok[i] == 255) continue;
-            primecount += H[Xblok[i]];
-            isum += (30*(long long)i)*H[Xblok[i]] + B[Xblok[i]];
-        }
+        bytescan<M>(Xblok, nturns, primecount, isum); // get coeffs for sum of 1/p
+        isum -= primecount*lead;
         
-        if (DEBUG_EG)
-            cerr << "prime count " << primecount << endl;
+        LOG(EG, TRACE) << "block " << k << ": offset " << offset << ", first prime at " << firstprime
+                       << ", prime count " << primecount << ", sum of i's " << isum;
         countA[k] = primecount;
-        
-        if (DEBUG_EG)
-            cerr << "sum of i's " << isum << endl;
         isumA[k] = isum;
-        
+        nprimes += primecount;
+        pr.update((double)(k+1)/numx, k+1, numx, nprimes);
 
         offset += xint;
     }
-    
+    pr.finish();
+
+    Arena::release(Xblok, xsize);
+    delete[] G;
+    delete[] Sblok;
+}
+
+// Walks the sieved blocks down from hi, where the sum is known
+// Returns the offset of the block in which the sum crosses the goal value
+// Updates sum according to where the offset left off
+lll schofeld_scan(ftype &sum, ftype goal, const EG_blocks &blocks)
+{
+    const vector<lll> &offsetA = blocks.offsetA;
+    const vector<long long> &countA = blocks.countA;
+    const vector<long long> &isumA = blocks.isumA;
+    long long xint = blocks.xint;
+    long long numx = offsetA.size();
+
     ftype cumulative = sum;
     
     for (long long k = numx-1; k >= 0; --k) {
@@ -298,8 +341,7 @@ long long schofeld_crossover(ftype &sum, ftype goal, long long lo, long long hi)
 
         ftype sum1p = countA[k]/offset_float - isumA[k]/(offset_float*offset_float);
         cumulative -= sum1p;
-        if (DEBUG_EG)
-            cerr << "cumulative: " << cumulative << " offset: " << offsetA[k] << endl;
+        LOG(EG, TRACE) << "cumulative: " << cumulative << " offset: " << offsetA[k];
         if (cumulative < goal) {
             sum = cumulative+sum1p;
             return offsetA[k] + xint;
@@ -309,3 +351,11 @@ long long schofeld_crossover(ftype &sum, ftype goal, long long lo, long long hi)
     return 0;
 }
 
+// Returns the offset of the block in which the sum crosses the goal value
+// Updates sum according to where the offset left off
+lll schofeld_crossover(ftype &sum, ftype goal, lll lo, lll hi)
+{
+    EG_blocks blocks;
+    schofeld_sieve(blocks, lo, hi);
+    return schofeld_scan(sum, goal, blocks);
+}
@@ -1,11 +1,26 @@
 // Computes full sum 1/p for all p <= x, inputted as a command line argument.
+// With -w count it computes pi(x) instead, exactly, with -w both the two
+// together from one sweep, and with -w power:s the sum of p^-s (see
+// weight.h).  With -plan it only prints the estimated time and memory of
+// each stage (planner.cpp), and with --mem-budget (e.g. 4G) it sizes its
+// tables to fit in that much memory.
+// With -fuse, S2 takes its primes from phi_s's segments (S2_fused in
+// S2.cpp) instead of sieving for them itself, so there are two stages, not
+// three: less work in all, but less to run side by side.
+// A running fullsum prints the state and ETA of every stage on SIGUSR1.
+// Tracing is picked with LOGLEVEL (log.h), e.g. LOGLEVEL=sp=debug.
 
 #include "utility.h"
 #include "special.cpp"
 #include "ordinary.cpp"
 #include "S2.cpp"
+#include "endgame.cpp"
+#include "pipeline.cpp"
+#include "planner.cpp"
 #include <iostream>
 #include <cstdio>
+#include <cstring>
+#include <string>
 
 using namespace std;
 
@@ -20,22 +35,90 @@ bool isNumber(char* input) {
 }
 
 void usage(char* name) {
-    printf("Usage: %s x\n", name);
+    printf("Usage: %s x [-w recip|count|both|power:s] [-fuse] [-plan] [--mem-budget bytes[K|M|G]]\n", name);
+}
+
+bool fuse = false;
+
+// phi_s and S2 in one sweep
+template <class W>
+void phi_s_and_s2(const vector<lll> &xs, vector<typename W::value> &special, vector<typename W::value> &rest) {
+    S2_fused<W> s2(xs);
+    phi_s_w<W>(xs, special, &s2);
+    s2.results(rest);
+}
+
+// The three parts for the weight W, concurrently
+template <class W>
+void weighted(lll x) {
+    vector<lll> xs(1, x);
+    vector<typename W::value> special, ordinary, rest;
+    Stagepool pool;
+    if (fuse) pool.add("phi_s+S2", [&]{ phi_s_and_s2<W>(xs, special, rest); });
+    else {
+        pool.add("phi_s", [&]{ phi_s_w<W>(xs, special); });
+        pool.add("S2", [&]{ s2_w<W>(xs, rest); });
+    }
+    pool.add("phi_o", [&]{ phi_o_w<W>(xs, ordinary); });
+    pool.run();
+    pool.report(cerr);
+    Arena::report(cerr);
+
+    cout << "phi_s: " << special[0] << endl;
+    cout << "phi_o: " << ordinary[0] << endl;
+    cout << "rest: " << rest[0] << endl;
+    cout << "total: " << special[0] + ordinary[0] + rest[0] << endl;
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 2 || !isNumber(argv[1])) {
+    Progress::watch();
+    string w = "recip";
+    bool planonly = false, ok = argc >= 2 && isNumber(argv[1]);
+    for (int i = 2; ok && i < argc; i++) {
+        if (!strcmp(argv[i], "-w") && i+1 < argc) w = argv[++i];
+        else if (!strcmp(argv[i], "-fuse")) fuse = true;
+        else if (!strcmp(argv[i], "-plan")) planonly = true;
+        else if (!strcmp(argv[i], "--mem-budget") && i+1 < argc) ok = (mem_budget = parse_bytes(argv[++i])) > 0;
+        else ok = false;
+    }
+    bool power = w.compare(0, 6, "power:") == 0 && w.size() > 6;
+    if (!ok || (w != "recip" && w != "count" && w != "both" && !power)) {
         usage(argv[0]);
+        return 0;
+    }
+    lll x = to_lll(argv[1]);
+    if (planonly || x >= PLAN_AUTO || mem_budget > 0) {
+        Plan pl = make_plan(x, 0, 0, planonly || x >= PLAN_AUTO);
+        if (mem_budget > 0) fit_budget(pl, mem_budget);
+        print_plan(pl, planonly ? cout : cerr);
+        if (planonly) return 0;
+        seed_progress(pl);
+    }
+
+    if (w != "recip" || fuse) {
+        Primecache::reserve(isqrt(x));
+        set_output_precision(30);
+        if (w == "recip") weighted<Wrecip>(x);
+        else if (w == "count") weighted<Wcount>(x);
+        else if (power) { Wpower::set(to_ftype(w.c_str() + 6)); weighted<Wpower>(x); }
+        else weighted<Wboth<Wcount, Wrecip> >(x);
     }
     else {
-        long long x = atoll(argv[1]);
-        ftype special = phi_s(x);
-        cout << "phi_s: " << special << endl;
+        // every stage takes its primes from one cached table up to sqrt(x)
+        Primecache::reserve(isqrt(x));
 
-        ftype ordinary = phi_o(x);
-        cout << "phi_o: " << ordinary << endl;
+        // the three parts are independent, so compute them concurrently
+        ftype special, ordinary, rest;
+        Stagepool pool;
+        pool.add("phi_s", [&]{ special = phi_s(x); });
+        pool.add("S2", [&]{ rest = sum1p_and_s2_m1(x); });
+        pool.add("phi_o", [&]{ ordinary = phi_o(x); });
+        pool.run();
+        pool.report(cerr);
+        Arena::report(cerr);
 
-        ftype rest = sum1p_and_s2_m1(x);
+        cout << "phi_s: " << special << endl;
+        cout << "phi_o: " << ordinary << endl;
         cout << "rest: " << rest << endl;
 
         ftype total = special + ordinary + rest;
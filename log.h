@@ -0,0 +1,191 @@
+// Leveled logging per subsystem, picked at run time
+//
+//    LOG(EG, DEBUG) << "prime count " << primecount;
+//
+// writes "eg: prime count ..." to stderr if the endgame's level is DEBUG
+// or more.  A site that is off costs a load and compare of a plain global,
+// the branch marked unlikely, and its arguments are never evaluated.
+// INFO and DEBUG lines go to stderr a line at a time.  TRACE is for the
+// sites inside hot loops: those lines go into a ring of LOG_RING lines,
+// and a thread of its own writes them out, so the loop formats its line
+// and moves on, never waiting on stderr.  When the ring is full, lines are
+// dropped and counted, not waited for.  What is left in the ring is
+// written at exit.
+//
+// The levels are read from LOGLEVEL in the environment at start-up:
+//    LOGLEVEL=debug              every subsystem at DEBUG
+//    LOGLEVEL=info,eg=trace      then the endgame at TRACE
+// with subsystems sp (phi_s), od (phi_o), s2, eg (endgame), bs (the final
+// prime-by-prime search) and misc, and levels off, info, debug, trace.
+// Log::set(spec) takes the same.  The default is info everywhere.
+
+#ifndef _LOG
+#define _LOG
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+#define LOG_RING 65536   // lines
+
+#define LOG(sub, lvl) \
+    if (__builtin_expect(Log::level[Log::sub] < Log::lvl, 1)) ; \
+    else Logline(Log::sub, Log::lvl)
+
+class Log
+{
+    public:
+        enum { SP, OD, S2, EG, BS, MISC, NSUB };
+        enum { OFF, INFO, DEBUG, TRACE };
+
+        static int level[NSUB];
+
+        // "debug", "eg=trace", "info,sp=off,s2=debug", ...; false if any
+        // part of it makes no sense (the rest still applies)
+        static bool set(const char *spec) {
+            bool ok = true;
+            string s(spec);
+            size_t i = 0;
+            while (i <= s.size()) {
+                size_t j = s.find(',', i);
+                if (j == string::npos) j = s.size();
+                string part = s.substr(i, j-i), sub, lvl = part;
+                size_t eq = part.find('=');
+                if (eq != string::npos) { sub = part.substr(0, eq); lvl = part.substr(eq+1); }
+                int l = find(lvl, levels, 4), k = sub.empty() ? -1 : find(sub, names, NSUB);
+                if (part.empty()) ;
+                else if (l < 0 || (!sub.empty() && k < 0)) ok = false;
+                else if (k < 0) for (k = 0; k < NSUB; k++) level[k] = l;
+                else level[k] = l;
+                i = j+1;
+            }
+            return ok;
+        }
+
+        static void write(int sub, int lvl, string &line) {
+            while (!line.empty() && line.back() == '\n') line.pop_back();
+            if (lvl == TRACE) ring().push(line);
+            else {
+                lock_guard<mutex> g(ring().out);
+                cerr << line << endl;
+            }
+        }
+
+        static void flush() { ring().drain(); }
+
+        static const char *names[NSUB];
+        static const char *levels[4];
+
+    private:
+        static int find(const string &s, const char *const *list, int n) {
+            for (int i = 0; i < n; i++) if (s == list[i]) return i;
+            return -1;
+        }
+
+        // TRACE lines, written by a thread of their own
+        struct Ring {
+            mutex lock, out;     // out: held while writing to stderr
+            condition_variable more, idle;
+            vector<string> slot;
+            size_t head, tail;   // lines head..tail-1 are waiting
+            long dropped;
+            bool started, busy;  // busy: the thread has lines not yet out
+
+            Ring() : slot(LOG_RING), head(0), tail(0), dropped(0), started(false), busy(false) {}
+
+            void push(string &line) {
+                lock_guard<mutex> g(lock);
+                if (!started) {
+                    started = true;
+                    thread([this]{ for (;;) writer(); }).detach();
+                    atexit(Log::flush);
+                }
+                if (tail - head == slot.size()) { dropped++; return; }
+                slot[tail++ % slot.size()].swap(line);
+                more.notify_one();
+            }
+
+            void writer() {
+                vector<string> batch;
+                unique_lock<mutex> g(lock);
+                more.wait(g, [this]{ return head < tail; });
+                long lost = take(batch);
+                busy = true;
+                g.unlock();
+                emit(batch, lost);
+                g.lock();
+                busy = false;
+                idle.notify_all();
+            }
+
+            // what is waiting, after what the thread has in hand
+            void drain() {
+                vector<string> batch;
+                unique_lock<mutex> g(lock);
+                long lost = take(batch);
+                idle.wait(g, [this]{ return !busy; });
+                g.unlock();
+                emit(batch, lost);
+            }
+
+            long take(vector<string> &batch) {
+                for (; head < tail; head++) batch.push_back(move(slot[head % slot.size()]));
+                long lost = dropped;
+                dropped = 0;
+                return lost;
+            }
+
+            void emit(const vector<string> &batch, long lost) {
+                lock_guard<mutex> o(out);
+                for (size_t i = 0; i < batch.size(); i++) cerr << batch[i] << '\n';
+                if (lost) cerr << "log: " << lost << " trace lines dropped" << '\n';
+                cerr.flush();
+            }
+        };
+
+        static Ring &ring() {
+            static Ring *r = new Ring;
+            return *r;
+        }
+};
+
+int Log::level[Log::NSUB] = { Log::INFO, Log::INFO, Log::INFO, Log::INFO, Log::INFO, Log::INFO };
+const char *Log::names[Log::NSUB] = { "sp", "od", "s2", "eg", "bs", "misc" };
+const char *Log::levels[4] = { "off", "info", "debug", "trace" };
+
+// Reads LOGLEVEL before main
+struct Log_init {
+    Log_init() {
+        const char *s = getenv("LOGLEVEL");
+        if (s && !Log::set(s)) cerr << "LOGLEVEL=" << s << ": not all understood" << endl;
+    }
+} log_init;
+
+// One line, written when the statement ends
+class Logline
+{
+    public:
+        Logline(int sub, int lvl) : sub(sub), lvl(lvl) {
+            os.precision(cerr.precision());
+            os << Log::names[sub] << ": ";
+        }
+        ~Logline() { string s = os.str(); Log::write(sub, lvl, s); }
+
+        template <class T>
+        Logline &operator<<(const T &v) { os << v; return *this; }
+        Logline &operator<<(ostream &(*f)(ostream &)) { os << f; return *this; }
+
+    private:
+        ostringstream os;
+        int sub, lvl;
+};
+
+#endif
@@ -20,18 +20,23 @@
 #include <stdio.h>
 #include <iostream>
 #include <cmath>
+#include <vector>
 
 using namespace std;
-using namespace NTL;
 
 #include "Primelist.h"
+#include "weight.h"
 
-#define SIZE 2000000
+#define SIZE 2000000  // smallest table; grown as needed for x beyond 10^18
 
-int mu[SIZE];  // I know, this should use a class ...
+vector<int> mu;  // I know, this should use a class ...
+int muN = 0;     // mu[] is filled in below muN
 
 void muinit(int N)
 {
+    if (muN >= N) return;  // already done, e.g. for an earlier x
+    muN = N;
+    mu.assign(N, 0);
     Primelist P(N);
     int i;
     int p;
@@ -44,68 +49,67 @@ void muinit(int N)
     P.reset();
     for (;;) {
         p = P.next();
-        if (DEBUG_OD)
-            cerr << "p = " << p << endl;
+        LOG(OD, TRACE) << "p = " << p;
         for(i = p;i<N;i+=p) mu[i] = -mu[i];
         if (p <= S) for(i = p*p;i<N;i+= p*p) mu[i] = 0;
         if (p == P.max()) break;
     }
 }
 
-// Returns the contribution of ordinary nodes for sum 1/p for all p <= x
-ftype phi_o(long long x) {
-    ftype gamma, log2;
-    gamma = to_ftype("0.57721566490153286060651209008240243");
-    log2 =  to_ftype("0.69314718055994530941723212145817657");
-    ftype::SetOutputPrecision(30);
-    
-    Primelist P(SIZE);
-    muinit(SIZE);
+// Returns the contribution of ordinary nodes for sum W::leaf(p) for all
+// p <= x: mu(m) f(m) phi_f(x/m, 1) over odd squarefree m <= x^(1/3),
+// with phi_f(y, 1) = W::oddsum(y) in closed form
+template <class W>
+typename W::value phi_o_w(lll x) {
+    static_assert(W::multiplicative, "phi_o needs a multiplicative weight");
+    typedef typename W::value value;
+    PERF_REGION("phi_o");
+    set_output_precision(30);
     
-        
-    ftype y,y2,y4,y6,
-    phi,t,
-    sum,sumpos,sumneg,sumomit,sumomit2;
+    value phi, t, sum, sumpos, sumneg;
     
     long int N,m,count;
     
-    N = to_long( floor(exp(log(x)/3)) );   // [ cube root of x ]
+    N = icbrt(x);   // [ cube root of x ], exactly, as phi_s and S2 have it
+    muinit(max((long)SIZE, N+1));
     
-    if (DEBUG_OD) {
-        cerr << x << endl;
-        cerr << N << endl;
-    }
+    LOG(OD, DEBUG) << "x = " << x << ", N = " << N;
 
-    sum = 0;
-    sumpos = 0;
-    sumneg = 0;
-    sumomit = 0;
-    sumomit2 = 0;
+    sum = W::zero();
+    sumpos = W::zero();
+    sumneg = W::zero();
     count = 0;
+    Progress &pr = Progress::start("phi_o", "m", "ordinary nodes");
     for (m=N;m>=1;m--) if (m&01 && mu[m]) {
-        y = 2*floor((x/m-1)/2) + 1; /* largest odd <= x/m */
-        y2 = y*y;
-        y4 = y2*y2;
-        y6 = y2*y4;
-        phi = log(y)/2  + (gamma + log2)/2 + 1/(2*y) - 1/(6*y2);
-        t = mu[m]*phi/m;
-        sum += t;
-        if (mu[m] > 0) sumpos += phi/m;
-        else sumneg += phi/m;
-        sumomit += mu[m]/(15*m*y4);
-        sumomit2 += 8*mu[m]/(63*m*y6);
+        if ((count & 0xffff) == 0) pr.update((double)(N-m)/N, N-m, N, count);
+        phi = W::scale(W::oddsum(x/m), m);
+        if (mu[m] > 0) { sum += phi; sumpos += phi; }
+        else { sum -= phi; sumneg += phi; }
         count++;
     }
+    pr.finish();
    
-    if (DEBUG_OD) { 
-        cerr << count << " ordinary nodes." << endl;
-        cerr << " sum of positive terms = " << sumpos << endl;
-        cerr << " sum of negative terms = " << sumneg << endl;
-        cerr << " sum = " << sum << endl;
-        cerr << " inconsistency : " << sum - (sumpos - sumneg) << endl;
-        cerr << " sum of first term omitted = " << sumomit << endl;
-        cerr << " sum of next after that= " << sumomit2 << endl;
-    }
+    LOG(OD, DEBUG) << count << " ordinary nodes.";
+    LOG(OD, DEBUG) << " sum of positive terms = " << sumpos;
+    LOG(OD, DEBUG) << " sum of negative terms = " << sumneg;
+    LOG(OD, DEBUG) << " sum = " << sum;
+    LOG(OD, DEBUG) << " inconsistency : " << sum - (sumpos - sumneg);
 
     return sum;
 }
+
+// Returns the contribution of ordinary nodes for sum 1/p for all p <= x
+ftype phi_o(lll x) {
+    return phi_o_w<Wrecip>(x);
+}
+
+// Batched version: phi_o for every x in xs, sharing the Mobius table
+template <class W>
+void phi_o_w(const vector<lll> &xs, vector<typename W::value> &result) {
+    result.resize(xs.size());
+    for (size_t j = 0; j < xs.size(); j++) result[j] = phi_o_w<W>(xs[j]);
+}
+
+void phi_o(const vector<lll> &xs, vector<ftype> &result) {
+    phi_o_w<Wrecip>(xs, result);
+}
@@ -3,6 +3,6 @@
 using namespace std;
 
 int main() {
-    quad_float result = phi_o(8);
+    ftype result = phi_o(8);
     cout << result << endl;
 }
@@ -0,0 +1,195 @@
+// Scoped instrumentation regions for the hot kernels
+//
+// Build with -DPERF_REGIONS (make PERFFLAGS=-DPERF_REGIONS fullsum) and
+// every PERF_REGION("name") in the code counts, for the rest of its
+// enclosing scope, the wall time and -- where perf_event_open is allowed
+// -- the cycles, instructions, last-level cache misses and branch
+// mispredictions of the calling thread.  Counts add up over all calls
+// and all threads, and a table of them goes to stderr when the program
+// exits.  Without PERF_REGIONS the macro expands to nothing.
+//
+// A region costs a few system calls at entry and exit (~1-2 usec), so
+// regions go around loops, not inside them: per segment in phi_s, per
+// block in the endgame.  IPC well below 1 with many LLC misses per 1000
+// instructions says a kernel waits on memory; high IPC says it computes.
+// Regions may nest; the counts of the outer one include the inner one.
+//
+// Under a hypervisor without a virtual PMU, or with perf_event_paranoid
+// above 2, the counters can't be opened and only the times are reported.
+
+#ifndef _PERFREGION
+#define _PERFREGION
+
+#ifdef PERF_REGIONS
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+using namespace std;
+
+#define PR_NCOUNTERS 4   // cycles, instructions, LLC misses, branch misses
+
+class Perfthread  // the counters of one thread, opened on first use
+{
+    public:
+        int fd[PR_NCOUNTERS];
+
+        Perfthread() {
+            static const unsigned long long config[PR_NCOUNTERS] = {
+                PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+            for (int i = 0; i < PR_NCOUNTERS; i++) {
+                struct perf_event_attr pe;
+                memset(&pe, 0, sizeof(pe));
+                pe.type = PERF_TYPE_HARDWARE;
+                pe.size = sizeof(pe);
+                pe.config = config[i];
+                pe.exclude_kernel = 1;   // allowed with perf_event_paranoid = 2
+                pe.exclude_hv = 1;
+                fd[i] = syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+            }
+        }
+
+        ~Perfthread() {
+            for (int i = 0; i < PR_NCOUNTERS; i++) if (fd[i] >= 0) close(fd[i]);
+        }
+
+        void read(unsigned long long *v) {
+            for (int i = 0; i < PR_NCOUNTERS; i++)
+                if (fd[i] < 0 || ::read(fd[i], &v[i], sizeof(v[i])) != sizeof(v[i]))
+                    v[i] = 0;
+        }
+
+        static Perfthread &mine() {
+            static thread_local Perfthread t;
+            return t;
+        }
+};
+
+class Perfregion  // totals for one PERF_REGION
+{
+    public:
+        const char *name;
+        unsigned long long calls;
+        double secs;
+        unsigned long long count[PR_NCOUNTERS];
+        bool counted[PR_NCOUNTERS];  // some call could read this counter
+        mutex lock;
+
+        // Regions live until exit, when the report needs them, so they
+        // are allocated once here and never freed.
+        static Perfregion &get(const char *name) {
+            Perfregion *r = new Perfregion(name);
+            lock_guard<mutex> g(registry_lock());
+            registry().push_back(r);
+            return *r;
+        }
+
+        void add(double t, const unsigned long long *c, const bool *ok) {
+            lock_guard<mutex> g(lock);
+            calls++;
+            secs += t;
+            for (int i = 0; i < PR_NCOUNTERS; i++) {
+                count[i] += c[i];
+                counted[i] = counted[i] || ok[i];
+            }
+        }
+
+        static void report(ostream &os) {
+            lock_guard<mutex> g(registry_lock());
+            vector<Perfregion *> &all = registry();
+            if (all.empty()) return;
+            os << setw(24) << left << "region" << right
+               << setw(10) << "calls" << setw(11) << "sec"
+               << setw(9) << "Gcycles" << setw(9) << "Ginstr" << setw(6) << "IPC"
+               << setw(9) << "LLC/ki" << setw(9) << "brm/ki" << endl;
+            bool anycounted = false;
+            for (size_t i = 0; i < all.size(); i++) {
+                Perfregion &r = *all[i];
+                os << setw(24) << left << r.name << right << setw(10) << r.calls
+                   << setw(11) << fixed << setprecision(4) << r.secs;
+                double ki = r.count[1] / 1000.0;
+                if (r.counted[0]) os << setw(9) << setprecision(3) << r.count[0]/1e9; else os << setw(9) << "-";
+                if (r.counted[1]) os << setw(9) << setprecision(3) << r.count[1]/1e9; else os << setw(9) << "-";
+                if (r.counted[0] && r.counted[1] && r.count[0])
+                    os << setw(6) << setprecision(2) << (double)r.count[1]/r.count[0];
+                else os << setw(6) << "-";
+                if (r.counted[2] && ki > 0) os << setw(9) << setprecision(3) << r.count[2]/ki; else os << setw(9) << "-";
+                if (r.counted[3] && ki > 0) os << setw(9) << setprecision(3) << r.count[3]/ki; else os << setw(9) << "-";
+                os << endl;
+                os.unsetf(ios::floatfield);
+                anycounted = anycounted || r.counted[0] || r.counted[1];
+            }
+            if (!anycounted)
+                os << "(no hardware counters: perf_event_open failed, times only)" << endl;
+        }
+
+    private:
+        Perfregion(const char *n) : name(n), calls(0), secs(0) {
+            for (int i = 0; i < PR_NCOUNTERS; i++) { count[i] = 0; counted[i] = false; }
+        }
+
+        static vector<Perfregion *> &registry() {
+            static vector<Perfregion *> *r = new vector<Perfregion *>;
+            return *r;
+        }
+
+        static mutex &registry_lock() {
+            static mutex *m = new mutex;
+            return *m;
+        }
+};
+
+class Perfscope  // adds the time and counts of its lifetime to a region
+{
+    private:
+        Perfregion &r;
+        chrono::steady_clock::time_point t0;
+        unsigned long long c0[PR_NCOUNTERS];
+
+    public:
+        Perfscope(Perfregion &region) : r(region) {
+            Perfthread::mine().read(c0);
+            t0 = chrono::steady_clock::now();
+        }
+
+        ~Perfscope() {
+            double t = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+            unsigned long long c[PR_NCOUNTERS];
+            bool ok[PR_NCOUNTERS];
+            Perfthread &th = Perfthread::mine();
+            th.read(c);
+            for (int i = 0; i < PR_NCOUNTERS; i++) {
+                ok[i] = th.fd[i] >= 0;
+                c[i] = ok[i] ? c[i] - c0[i] : 0;
+            }
+            r.add(t, c, ok);
+        }
+};
+
+struct Perfreport {  // prints the table at exit
+    ~Perfreport() { Perfregion::report(cerr); }
+};
+static Perfreport perf_report_at_exit;
+
+#define PR_CAT2(a, b) a##b
+#define PR_CAT(a, b) PR_CAT2(a, b)
+#define PERF_REGION(name) \
+    static Perfregion &PR_CAT(pr_region_, __LINE__) = Perfregion::get(name); \
+    Perfscope PR_CAT(pr_scope_, __LINE__)(PR_CAT(pr_region_, __LINE__))
+
+#else
+
+#define PERF_REGION(name)
+
+#endif
+
+#endif
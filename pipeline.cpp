@@ -0,0 +1,85 @@
+// Runs independent stages of the computation concurrently.
+//
+// phi_s, phi_o and sum1p_and_s2_m1 don't depend on each other until
+// their results are added, and the endgame sieve of [x-, x+] only needs
+// the total for its final scan (see schofeld_scan).  So fullsum and
+// crossover hand each of them to a Stagepool, which runs them on a
+// shared set of threads and reports the wall time of every stage.
+// End-to-end time is then that of the slowest stage rather than the sum.
+//
+// Usage:
+//    Stagepool pool;
+//    pool.add("phi_s", [&]{ special = phi_s(x); });
+//    ...
+//    pool.run();          // returns when every stage is done
+//    pool.report(cerr);
+
+#include "utility.h"
+#include <iostream>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+using namespace std;
+
+class Stagepool
+{
+    private:
+        struct Stage {
+            const char *name;
+            function<void()> run;
+            double secs;    // wall time, filled in by run()
+        };
+        vector<Stage> stages;
+        double elapsed;     // wall time of the whole pool
+
+        static double now() {
+            return chrono::duration<double>(
+                chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+    public:
+        Stagepool() : elapsed(0) {}
+
+        // Stages are started in the order added, so add the longest first
+        void add(const char *name, function<void()> f) {
+            Stage s = { name, f, 0 };
+            stages.push_back(s);
+        }
+
+        // Runs every stage on up to nthreads threads (0 = one per core)
+        void run(unsigned nthreads = 0) {
+            if (nthreads == 0) nthreads = thread::hardware_concurrency();
+            if (nthreads == 0) nthreads = 1;
+            if (nthreads > stages.size()) nthreads = stages.size();
+
+            atomic<size_t> nextstage(0);
+            double start = now();
+            auto worker = [&]() {
+                for (;;) {
+                    size_t i = nextstage++;
+                    if (i >= stages.size()) break;
+                    double t = now();
+                    stages[i].run();
+                    stages[i].secs = now() - t;
+                }
+            };
+
+            vector<thread> threads;
+            for (unsigned i = 1; i < nthreads; i++) threads.push_back(thread(worker));
+            worker();
+            for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+            elapsed = now() - start;
+        }
+
+        void report(ostream &os) {
+            double sum = 0;
+            for (size_t i = 0; i < stages.size(); i++) {
+                os << "stage " << stages[i].name << ": " << stages[i].secs << " sec" << endl;
+                sum += stages[i].secs;
+            }
+            os << "all stages: " << elapsed << " sec wall, " << sum << " sec if run in sequence" << endl;
+        }
+};
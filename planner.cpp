@@ -0,0 +1,251 @@
+// Run planner: time and memory of each stage at x, before running it
+//
+// Times come from short calibration runs.  phi_s and S2 are timed at
+// x1 = min(x, PLAN_X1) and at x1/100, which gives a local exponent e
+// (both go about as x^(2/3)), and the time at x is t(x1) (x/x1)^e.  phi_o
+// is a loop over m <= x^(1/3) once its Mobius table is built, so it is
+// timed cold and warm at x1, and the warm time scaled by (x/x1)^(1/3)
+// and the table by its size.  The endgame sieve is timed on a piece
+// of [x-, x+] at its top end and scaled by length.  Memory is counted
+// from the sizes of the tables each stage allocates.  The special node
+// count is the LMO estimate a^2/2, a = pi(x^(1/3)); special.cpp found it
+// good to about 1% at 10^9.
+//
+// fullsum and crossover print the plan with -plan, and seed the ETAs of
+// their progress reports (progress.h) with it for x >= PLAN_AUTO.
+//
+// With --mem-budget, fit_budget shrinks the tables that can give (the
+// endgame block, the easy leaf table, the phi_s segment) so that all the
+// stages, running at once, fit in it.  Their big tables come from the
+// Arena (arena.h), which reports the peak at the end of the run.
+
+// Include it after special.cpp, ordinary.cpp, S2.cpp and endgame.cpp.
+
+#include "utility.h"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+#define PLAN_X1 100000000000LL       // largest calibration run
+#define PLAN_AUTO 100000000000000LL  // plan every run from here on
+#define PLAN_EGLEN 300000000LL       // length of the endgame calibration sieve
+
+struct Plan {
+    lll x, xlo, xhi;        // endgame over [xlo, xhi], if xhi > xlo
+    long n13, a;
+    double nodes;           // special nodes, LMO estimate
+    long long L, nseg;      // phi_s segments
+    long easymax;           // easy leaf table
+    long long xint;         // endgame block
+    double budget;          // bytes, 0 if none
+    double secs[4], bytes[4];
+};
+
+const char *plan_stage[4] = { "phi_s", "phi_o", "S2", "endgame sieve" };
+
+// pi(n), near enough for sizing tables
+double plan_pi(double n) { return n < 3 ? 1 : 1.1*n/log(n); }
+
+double plan_now() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Wall time of f, with the stage's progress output thrown away
+template <class F>
+double plan_time(F f) {
+    ofstream null("/dev/null");
+    streambuf *err = cerr.rdbuf(null.rdbuf());
+    double t = plan_now();
+    f();
+    t = plan_now() - t;
+    cerr.rdbuf(err);
+    return t;
+}
+
+// t(x) from runs at x1 and x1/100
+template <class F>
+double plan_scale(lll x, F f) {
+    lll x1 = x < PLAN_X1 ? x : PLAN_X1;
+    double t1 = plan_time([&]{ f(x1); });
+    if (x == x1) return t1;
+    double t0 = plan_time([&]{ f(x1/100); });
+    double e = t0 > 0 ? log(t1/t0)/log(100.0) : 2.0/3;
+    e = min(max(e, 0.3), 1.0);   // keep timer noise from running away
+    return t1*pow((double)x/(double)x1, e);
+}
+
+string plan_bytes(double b) {
+    char buf[32];
+    if (b < 1e6) snprintf(buf, sizeof(buf), "%.0f KB", b/1e3);
+    else if (b < 1e9) snprintf(buf, sizeof(buf), "%.1f MB", b/1e6);
+    else snprintf(buf, sizeof(buf), "%.2f GB", b/1e9);
+    return buf;
+}
+
+// The tables phi_s and the endgame can size to fit
+double plan_easy_bytes(double easymax) { return easymax/30 + (easymax/240+1)*sizeof(ftype); }
+double plan_seg_bytes(double L) { return L*(1 + sizeof(ftype)/3.0); }
+
+const double plan_eg_ipb = (double)EG_WHEEL/EG_wheel<EG_WHEEL>::bytes;   // integers per byte of block
+
+double plan_eg_bytes(const Plan &pl, double xint) {
+    double q = pow((double)pl.xhi, 1.0/4);
+    return xint/plan_eg_ipb + 1.26*plan_pi(q*q) + q + 48*(double)(pl.xhi - pl.xlo)/xint;
+}
+
+// What each stage allocates, from the table sizes in pl
+void plan_memory(Plan &pl)
+{
+    double f = sizeof(ftype), sx = sqrt((double)pl.x), x13 = pow((double)pl.x, 1.0/3);
+    double N = max((double)SIZE, x13+1);
+    // Mobius, smallest factors (while building) and Mprimetable, primes,
+    // the easy leaf table, a degree-4 RangeArray, and C, Sb, Nextmprime
+    pl.bytes[0] = 9.0*pl.n13 + 4*plan_pi(pl.n13) + plan_easy_bytes(pl.easymax)
+                + plan_seg_bytes(pl.L) + pl.a*(2*f + 8);
+    // Mobius table, and the primes that fill it
+    pl.bytes[1] = 4*N + 4*plan_pi(N) + N/30;
+    // primes up to sqrt x with their bitmap, and the segment bitmap
+    pl.bytes[2] = (sx < 4294967296.0 ? 4 : 8)*plan_pi(sx) + sx/30 + x13/8;
+    pl.bytes[3] = pl.xhi > pl.xlo ? plan_eg_bytes(pl, pl.xint) : 0;
+}
+
+// Without timed, only the memory is planned
+Plan make_plan(lll x, lll xlo = 0, lll xhi = 0, bool timed = true)
+{
+    Plan pl;
+    pl.x = x; pl.xlo = xlo; pl.xhi = xhi;
+    double x13 = pow((double)x, 1.0/3);
+    pl.n13 = (long)(x13+EP);
+    Primelist P(pl.n13);
+    for (pl.a = 0; pl.a < P.length() && P[pl.a] <= pl.n13; pl.a++) ;
+    pl.nodes = (double)pl.a*pl.a/2;
+    pl.L = phi_s_seglen(x13);
+    pl.nseg = (long long)(x13*x13+EP)/pl.L + 1;
+    pl.easymax = (long)max(min(sqrt((double)x), (double)(phi_s_easymax > 0 ? phi_s_easymax : PHI_S_EASYMAX)), x13+1);
+    pl.xint = eg_xint > 0 ? eg_xint : (long long)pow((double)(xhi - xlo), 3.0/4);
+    pl.budget = 0;
+
+    for (int i = 0; i < 4; i++) pl.secs[i] = 0;
+    if (timed) {
+        pl.secs[0] = plan_scale(x, [](lll y){ phi_s(y); });
+        lll x1 = x < PLAN_X1 ? x : PLAN_X1;
+        double cold = plan_time([&]{ phi_o(x1); });
+        double warm = plan_time([&]{ phi_o(x1); });
+        double N = max((double)SIZE, x13+1);
+        pl.secs[1] = max(cold - warm, 0.0)*N/max((double)SIZE, pow((double)x1, 1.0/3)+1)
+                   + warm*pow((double)x/(double)x1, 1.0/3);
+        pl.secs[2] = plan_scale(x, [](lll y){ sum1p_and_s2_m1(y); });
+        if (xhi > xlo) {
+            lll len = xhi - xlo, piece = len < PLAN_EGLEN ? len : PLAN_EGLEN;
+            double t = plan_time([&]{ EG_blocks b; schofeld_sieve(b, xhi - piece, xhi); });
+            pl.secs[3] = t*(double)len/(double)piece;
+        }
+    }
+    plan_memory(pl);
+    return pl;
+}
+
+// Memory budget (--mem-budget), in bytes; 0 for none
+double mem_budget = 0;
+
+// 4G, 512M, 300K or plain bytes; 0 if it isn't one
+double parse_bytes(const char *s)
+{
+    char *end;
+    double b = strtod(s, &end);
+    if (end == s || b <= 0) return 0;
+    switch (*end) {
+        case 'G': case 'g': b *= 1e9; end++; break;
+        case 'M': case 'm': b *= 1e6; end++; break;
+        case 'K': case 'k': b *= 1e3; end++; break;
+    }
+    return *end ? 0 : b;
+}
+
+// Shrinks the tables of pl that can give until the stages, all running
+// at once, fit in budget bytes, and sets them for the run (seglen,
+// phi_s_easymax, eg_xint).  They never grow past what they would be
+// anyway: a bigger endgame block makes find_crossover's exact scan of
+// the last block longer.  The endgame block gives first, as more blocks
+// cost little; then the easy leaf table, which makes phi_s slower (the
+// times in pl are not redone); then the phi_s segment.  Returns false if
+// even the smallest tables don't fit, and uses those.
+bool fit_budget(Plan &pl, double budget)
+{
+    const long long Lmin = 4096, xmin = 30LL*65536;
+    bool eg = pl.xhi > pl.xlo;
+
+    Plan p0 = pl;   // the smallest tables
+    p0.easymax = pl.n13 + 1;
+    p0.L = min(pl.L, Lmin);
+    p0.xint = min(pl.xint, xmin);
+    plan_memory(p0);
+    plan_memory(pl);
+    pl.budget = budget;
+    double least = p0.bytes[0] + p0.bytes[1] + p0.bytes[2] + p0.bytes[3];
+    double over = pl.bytes[0] + pl.bytes[1] + pl.bytes[2] + pl.bytes[3] - budget;
+    bool ok = least <= budget;
+    if (!ok) {
+        cerr << "memory budget " << plan_bytes(budget) << " is below the "
+             << plan_bytes(least) << " this run needs at least" << endl;
+        pl.L = p0.L; pl.easymax = p0.easymax; pl.xint = p0.xint;
+    }
+    else if (over > 0) {
+        if (eg) {   // the bitmap is most of it
+            double want = max(plan_eg_bytes(pl, pl.xint) - over, plan_eg_bytes(p0, p0.xint));
+            double xint = pl.xint;
+            for (int i = 0; i < 4; i++)
+                xint = max(plan_eg_ipb*(want - (plan_eg_bytes(pl, xint) - xint/plan_eg_ipb)), (double)p0.xint);
+            over -= plan_eg_bytes(pl, pl.xint) - plan_eg_bytes(pl, xint);
+            pl.xint = (long long)xint;
+        }
+        if (over > 0) {
+            double give = min(over, plan_easy_bytes(pl.easymax) - plan_easy_bytes(p0.easymax));
+            over -= give;
+            pl.easymax = max(p0.easymax, (long)(pl.easymax - give/(1.0/30 + sizeof(ftype)/240.0)));
+        }
+        if (over > 0)
+            pl.L = max(p0.L, pl.L - (long long)(over/plan_seg_bytes(1)));
+    }
+    pl.nseg = (long long)(pow((double)pl.x, 2.0/3)+EP)/pl.L + 1;
+    plan_memory(pl);
+    seglen = pl.L;
+    phi_s_easymax = pl.easymax;
+    eg_xint = eg ? pl.xint : 0;
+    return ok;
+}
+
+void print_plan(const Plan &pl, ostream &os)
+{
+    os << "Plan for x = " << pl.x;
+    if (pl.xhi > pl.xlo) os << ", endgame over [" << pl.xlo << ", " << pl.xhi << "]";
+    os << endl;
+    os << "  x^(1/3) = " << pl.n13 << ", a = " << pl.a << ", special nodes ~ "
+       << setprecision(3) << pl.nodes << " (LMO a^2/2)" << endl;
+    os << "  phi_s: " << pl.nseg << " segments of " << pl.L << ", easy leaves up to " << pl.easymax << endl;
+    if (pl.xhi > pl.xlo)
+        os << "  endgame: " << (pl.xhi - pl.xlo + pl.xint - 1)/pl.xint << " blocks of " << pl.xint << endl;
+    if (pl.budget > 0) os << "  sized for a budget of " << plan_bytes(pl.budget) << endl;
+    double wall = 0, cpu = 0, mem = 0;
+    for (int i = 0; i < 4; i++) {
+        if (i == 3 && pl.xhi <= pl.xlo) continue;
+        os << "  " << setw(14) << left << plan_stage[i] << right
+           << setw(10) << (pl.secs[i] > 0 ? Progress::hms(pl.secs[i]) : "-") << setw(12) << plan_bytes(pl.bytes[i]) << endl;
+        wall = max(wall, pl.secs[i]);
+        cpu += pl.secs[i];
+        mem += pl.bytes[i];
+    }
+    os << "  " << setw(14) << left << "concurrent" << right
+       << setw(10) << (wall > 0 ? Progress::hms(wall) : "-") << setw(12) << plan_bytes(mem)
+       << "   (" << Progress::hms(cpu) << " of cpu)" << endl;
+}
+
+// Hands the estimates to the progress reports
+void seed_progress(const Plan &pl)
+{
+    for (int i = 0; i < 4; i++) if (pl.secs[i] > 0) Progress::plan(plan_stage[i], pl.secs[i]);
+}
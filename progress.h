@@ -0,0 +1,171 @@
+// Progress, ETA and a state dump for long runs
+//
+// A stage registers with Progress::start(name) and reports as it goes:
+//    Progress &pr = Progress::start("phi_s", "segment", "special nodes");
+//    pr.update(fraction, k, nseg, nodes);
+// where fraction is its own idea of how much of the work is done.  The
+// ETA is corrected by observed throughput: with f done after t seconds
+// the stage is on course for t/f, and if the planner (planner.cpp) gave
+// an estimate T beforehand the two are blended, (1-f) T + f (t/f), so the
+// plan counts early and the measurement late.  The ETA is the (1-f) of
+// that still to go.
+//
+// Progress::watch() (call it first thing in main, before any threads)
+// makes SIGUSR1 print every stage's state and ETA to stderr:
+//    kill -USR1 <pid>
+// The signal is taken by a thread of its own with sigwait, so the dump
+// never runs inside a signal handler.
+
+#ifndef _PROGRESS
+#define _PROGRESS
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <csignal>
+#include <pthread.h>
+
+using namespace std;
+
+class Progress
+{
+    public:
+        const char *name, *unit, *auxname;
+        double planned;         // seconds, from the planner; 0 if none
+
+        // Registers a stage.  Stages live until exit, but one that has
+        // finished is reused by the next stage of the same name, so a
+        // server calling phi_s over and over keeps one entry for it.
+        static Progress &start(const char *name, const char *unit = "step", const char *auxname = NULL) {
+            lock_guard<mutex> g(registry_lock());
+            vector<Progress *> &all = registry();
+            Progress *p = NULL;
+            for (size_t i = 0; i < all.size() && p == NULL; i++)
+                if (all[i]->finished && string(all[i]->name) == name) p = all[i];
+            if (p == NULL) {
+                p = new Progress(name, unit, auxname);
+                all.push_back(p);
+            }
+            else {
+                lock_guard<mutex> h(p->lock);
+                p->unit = unit; p->auxname = auxname;
+                p->t0 = now(); p->f = 0; p->n = p->ntotal = p->naux = 0;
+                p->finished = false; p->planned = 0;
+            }
+            map<string, double> &pl = plans();
+            if (pl.count(name)) p->planned = pl[name];
+            return *p;
+        }
+
+        // Estimated time of a stage started later, from the planner
+        static void plan(const char *name, double secs) {
+            lock_guard<mutex> g(registry_lock());
+            plans()[name] = secs;
+        }
+
+        void update(double fraction, long long done, long long total, long long aux = 0) {
+            lock_guard<mutex> g(lock);
+            f = fraction; n = done; ntotal = total; naux = aux;
+        }
+
+        void finish() { lock_guard<mutex> g(lock); f = 1; finished = true; fin = now(); }
+
+        double elapsed() { return (finished ? fin : now()) - t0; }
+
+        // Seconds left, or -1 if there is nothing to go on yet
+        double eta() {
+            lock_guard<mutex> g(lock);
+            if (finished) return 0;
+            double t = now() - t0;
+            if (f <= 0) return planned > 0 ? max(planned - t, 0.0) : -1;
+            double total = planned > 0 ? (1-f)*planned + t : t/f;   // f (t/f) = t
+            return (1-f)*total;
+        }
+
+        string state() {
+            ostringstream os;
+            double left = eta();
+            lock_guard<mutex> g(lock);
+            os << name << ": ";
+            if (finished) os << "done in " << hms(fin - t0);
+            else {
+                char pct[16];
+                snprintf(pct, sizeof(pct), "%.1f%%", 100*f);
+                os << pct << " (" << unit << " " << n << " of " << ntotal;
+                if (auxname) os << ", " << naux << " " << auxname;
+                os << "), " << hms(now() - t0) << " elapsed, ETA "
+                   << (left < 0 ? string("?") : hms(left));
+                if (planned > 0) os << " (planned " << hms(planned) << ")";
+            }
+            return os.str();
+        }
+
+        static void dump(ostream &os) {
+            lock_guard<mutex> g(registry_lock());
+            vector<Progress *> &all = registry();
+            if (all.empty()) os << "no stages started yet" << endl;
+            for (size_t i = 0; i < all.size(); i++) os << all[i]->state() << endl;
+        }
+
+        // Dumps the state on every SIGUSR1 from now on.  Threads inherit
+        // the signal mask, so call this before starting any.
+        static void watch() {
+            sigset_t s;
+            sigemptyset(&s);
+            sigaddset(&s, SIGUSR1);
+            pthread_sigmask(SIG_BLOCK, &s, NULL);
+            thread([s]{
+                for (;;) {
+                    int sig;
+                    if (sigwait(&s, &sig) == 0) dump(cerr);
+                }
+            }).detach();
+        }
+
+        static string hms(double secs) {
+            char buf[32];
+            long s = (long)(secs + 0.5);
+            if (secs < 60) snprintf(buf, sizeof(buf), "%.1fs", secs);
+            else if (s < 3600) snprintf(buf, sizeof(buf), "%ldm%02lds", s/60, s%60);
+            else if (s < 86400) snprintf(buf, sizeof(buf), "%ldh%02ldm", s/3600, s/60%60);
+            else snprintf(buf, sizeof(buf), "%ldd%02ldh", s/86400, s/3600%24);
+            return buf;
+        }
+
+    private:
+        double t0, fin, f;
+        long long n, ntotal, naux;
+        bool finished;
+        mutex lock;
+
+        Progress(const char *nm, const char *u, const char *a)
+            : name(nm), unit(u), auxname(a), planned(0), t0(now()), fin(0), f(0),
+              n(0), ntotal(0), naux(0), finished(false) {}
+
+        static double now() {
+            return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        static vector<Progress *> &registry() {
+            static vector<Progress *> *r = new vector<Progress *>;
+            return *r;
+        }
+
+        static map<string, double> &plans() {
+            static map<string, double> *p = new map<string, double>;
+            return *p;
+        }
+
+        static mutex &registry_lock() {
+            static mutex *m = new mutex;
+            return *m;
+        }
+};
+
+#endif
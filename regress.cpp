@@ -0,0 +1,309 @@
+// End-to-end regression suite: results against the reference values in
+// the sources, and time and memory against a stored baseline.
+//
+// Runs the stages of fullsum (phi_s, phi_o, S2) at a ladder of x, the
+// stages of crossover at a few y, and the RangeArray test Stest, each in
+// a child process of its own, so every stage gets its own wall time and
+// peak RSS (from wait4).  Results come back to the parent through a pipe
+// as raw ftype, so nothing is lost to printing.  A stage's result is then
+// checked against the reference for it:
+//
+//    phi_s   10^3 .. 10^12 (10^15 with -full)    special.cpp, Maple/RR
+//    phi_o   10^18                               ordinary.cpp
+//    total   10^6 (to 18 digits, see below)      RangeArray.h, Maple
+//    stest   10^6                                RangeArray.h, Maple
+//    pi      10^9, phi_s and S2 fused            50847534
+//    crossover 1 .. 2.4, below SI_DUSART         5, 11, 97, 277, 1013, 4789
+//    crossover 3 (and 4 with -full)              5195977, 1801241230056600523
+//
+// A float check passes when it agrees to the digits asked for (-d,
+// default 28; quad_float and FTYPE_DD give 30 or more, FTYPE_DOUBLE about
+// 13), or to all the digits the reference has, if that is fewer.
+//
+// With -b, each stage's time is compared with the baseline file, and one
+// more than -t (default 0.25, i.e. 25%) slower, and by at least
+// REGRESS_NOISE seconds, is flagged.  -w writes this run as the new
+// baseline.  The exit status is 1 if anything failed or was flagged.
+// "make runregress" checks against regress.csv, "make regress-baseline"
+// rewrites it.  Timings only mean something on the machine that made
+// them, so regress.csv is not in git: record one with "make
+// regress-baseline" on a quiet machine, before the change to be timed.
+// If the -b file is missing or empty, regress says so and records this
+// run there, so the first "make runregress" makes the baseline.
+//
+// Usage: regress [-full] [-d digits] [-b baseline] [-t threshold] [-w newbaseline] [-v]
+
+#include "utility.h"
+#include "special.cpp"
+#include "ordinary.cpp"
+#include "S2.cpp"
+#include "sinterval.cpp"
+#include "endgame.cpp"
+#include "blocksieve.cpp"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+#define REGRESS_NOISE 0.05   // seconds; smaller slowdowns are timer noise
+
+struct Row {
+    string name;        // case/stage, the key for the baseline
+    double secs;
+    long rss;           // peak RSS of the stage, in KB
+    bool ok;
+};
+
+vector<Row> rows;
+bool verbose = false;
+bool failed = false;
+
+// Runs f in a child process and returns its result in out; records the
+// wall time and peak RSS of the child under name
+template <class V>
+bool stage(const string &name, function<V()> f, V &out)
+{
+    int fd[2];
+    if (pipe(fd) < 0) { perror("pipe"); exit(1); }
+    cout << flush;
+    double t0 = chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+    pid_t pid = fork();
+    if (pid < 0) { perror("fork"); exit(1); }
+    if (pid == 0) {
+        close(fd[0]);
+        if (!verbose) {   // the stages report progress on stderr
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, 2);
+        }
+        V v = f();
+        if (write(fd[1], &v, sizeof(v)) != sizeof(v)) _exit(1);
+        _exit(0);
+    }
+    close(fd[1]);
+    ssize_t n = read(fd[0], &out, sizeof(out));
+    close(fd[0]);
+    int status;
+    struct rusage ru;
+    wait4(pid, &status, 0, &ru);
+    double t1 = chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+
+    Row r = { name, t1 - t0, ru.ru_maxrss, n == sizeof(out) && WIFEXITED(status) && WEXITSTATUS(status) == 0 };
+    rows.push_back(r);
+    printf("%-28s %10.3f s %10ld KB%s\n", name.c_str(), r.secs, r.rss, r.ok ? "" : "   FAILED");
+    if (!r.ok) failed = true;
+    return r.ok;
+}
+
+string str(lll v) {
+    ostringstream os;
+    os << v;
+    return os.str();
+}
+
+// Significant digits in a decimal string
+int sigdigits(const char *s)
+{
+    int n = 0;
+    bool lead = true;
+    for (; *s && *s != 'e' && *s != 'E'; s++) {
+        if (*s < '0' || *s > '9') continue;
+        if (*s != '0') lead = false;
+        if (!lead) n++;
+    }
+    return n;
+}
+
+void check(const string &name, ftype got, const char *ref, int digits)
+{
+    ftype r = to_ftype(ref);
+    ftype err = fabs(got - r);
+    double agree = err == 0 ? 99 : -log10(ftod(err/fabs(r)));
+    int want = min(digits, sigdigits(ref) - 1);
+    bool ok = agree >= want;
+    cout << setw(28) << left << name << right << " " << got << "  "
+         << (agree >= 99 ? string("all") : to_string((int)agree)) << " digits"
+         << (ok ? "" : "   FAIL (want " + to_string(want) + ")") << endl;
+    if (!ok) failed = true;
+}
+
+void check(const string &name, lll got, lll ref)
+{
+    bool ok = got == ref;
+    cout << setw(28) << left << name << right << " " << got
+         << (ok ? "" : "   FAIL (want " + str(ref) + ")") << endl;
+    if (!ok) failed = true;
+}
+
+// sum 1/p for p <= n by sifting a RangeArray, as Stest does
+ftype stest(long n)
+{
+    RangeArray R(1, n, 2097152);
+    Primelist P((long)sqrt(n)+1);
+    ftype total = to_ftype(0);
+    P.reset();
+    for (;;) {
+        long p = P.next();
+        total += Wrecip::leaf(p);
+        R.sift(p);
+        if (p == P.max()) break;
+    }
+    return total + R.total() - 1;
+}
+
+// The three parts of the sum at x, one stage each
+bool parts(const string &name, lll x, ftype &special, ftype &ordinary, ftype &rest)
+{
+    long sq = (long)sqrt((double)x)+1;
+    return stage<ftype>(name + "/phi_s", [x, sq]{ Primecache::reserve(sq); return phi_s(x); }, special)
+        && stage<ftype>(name + "/phi_o", [x]{ return phi_o(x); }, ordinary)
+        && stage<ftype>(name + "/S2", [x, sq]{ Primecache::reserve(sq); return sum1p_and_s2_m1(x); }, rest);
+}
+
+void usage(char *name) {
+    printf("Usage: %s [-full] [-d digits] [-b baseline] [-t threshold] [-w newbaseline] [-v]\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    bool full = false;
+    int digits = 28;
+    double threshold = 0.25;
+    const char *baseline = NULL, *newbaseline = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-full")) full = true;
+        else if (!strcmp(argv[i], "-d") && i+1 < argc) digits = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-b") && i+1 < argc) baseline = argv[++i];
+        else if (!strcmp(argv[i], "-t") && i+1 < argc) threshold = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-w") && i+1 < argc) newbaseline = argv[++i];
+        else if (!strcmp(argv[i], "-v")) verbose = true;
+        else { usage(argv[0]); return 1; }
+    }
+    set_output_precision(30);
+
+    // phi_s: special.cpp (Maple to 40 digits, RR for 10^12, quad_float for 10^15)
+    struct { lll x; const char *ref; bool full; } special_refs[] = {
+        { 1000, "0.3531538468599592868411505015333118978661", false },
+        { 1000000, "0.9801924829696929969211233597748507920510", false },
+        { 1000000000, "1.205523070410312238229462519833430734613", false },
+        { 1000000000000LL, "1.25854648643047059759641688201818410321297122", false },
+        { 1000000000000000LL, "1.24862902556037133904243183442", true },
+    };
+    for (size_t i = 0; i < sizeof(special_refs)/sizeof(special_refs[0]); i++) {
+        if (special_refs[i].full && !full) continue;
+        lll x = special_refs[i].x;
+        string name = "fullsum " + str(x);
+        ftype special, ordinary, rest;
+        if (!parts(name, x, special, ordinary, rest)) continue;
+        check(name + " phi_s", special, special_refs[i].ref, digits);
+        // RangeArray.h, Maple.  Here phi_o's closed form leaves out about
+        // 1/(15 y^4) at y = x^(2/3) = 10^4, so only 18 digits can agree
+        if (x == 1000000)
+            check(name + " total", special + ordinary + rest,
+                    "2.887328099567672712348011299009470085543", min(digits, 18));
+    }
+
+    // phi_o: ordinary.cpp
+    ftype ordinary;
+    if (stage<ftype>("phi_o 1e18", []{ return phi_o((lll)1000000000000000000LL); }, ordinary))
+        check("phi_o 1e18", ordinary, "1.00246314333470707257198312163", digits);
+
+    // phi_s with S2 riding on it (S2_fused), counting primes
+    lll pi;
+    if (stage<lll>("pi 1e9 fused", []{
+                vector<lll> xs(1, 1000000000);
+                vector<long long> special, ordinary, rest;
+                S2_fused<Wcount> s2(xs);
+                phi_s_w<Wcount>(xs, special, &s2);
+                s2.results(rest);
+                phi_o_w<Wcount>(xs, ordinary);
+                return (lll)(special[0] + ordinary[0] + rest[0]);
+            }, pi))
+        check("pi 1e9 fused", pi, 50847534);
+
+    // Stest: RangeArray.h
+    ftype s;
+    if (stage<ftype>("stest 1e6", []{ return stest(1000000); }, s))
+        check("stest 1e6", s, "2.887328099567672712348011299009470085543", digits);
+
+    // crossover: the smallest prime with sum 1/p > y
+    struct { const char *y; lll p; bool full; } crossover_refs[] = {
+        { "1", 5, false },
+        { "1.2", 11, false },
+        { "1.8", 97, false },
+        { "2", 277, false },
+        { "2.2", 1013, false },
+        { "2.4", 4789, false },
+        { "3", 5195977, false },
+        { "4", (lll)1801241230056600523LL, true },
+    };
+    for (size_t i = 0; i < sizeof(crossover_refs)/sizeof(crossover_refs[0]); i++) {
+        if (crossover_refs[i].full && !full) continue;
+        string name = string("crossover ") + crossover_refs[i].y;
+        ftype y = to_ftype(crossover_refs[i].y);
+        lll xlo, xhi;
+        schoenfeld_interval(y, xlo, xhi);
+        xhi += (30 - xhi%30);
+        ftype special, ordinary, rest;
+        if (!parts(name, xhi, special, ordinary, rest)) continue;
+        ftype total = special + ordinary + rest;
+        lll p;
+        if (stage<lll>(name + "/endgame", [&]{
+                    Primecache::reserve((long)sqrt((double)xhi)+1);
+                    EG_blocks blocks;
+                    schofeld_sieve(blocks, xlo, xhi);
+                    ftype sum = total;
+                    lll block_crossover = schofeld_scan(sum, y, blocks);
+                    return find_crossover(sum, y, xlo, block_crossover);
+                }, p))
+            check(name, p, crossover_refs[i].p);
+    }
+
+    if (baseline) {
+        map<string, double> base;
+        ifstream in(baseline);
+        string line;
+        while (getline(in, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            size_t c = line.find(',');
+            if (c != string::npos) base[line.substr(0, c)] = atof(line.c_str() + c + 1);
+        }
+        if (base.empty()) {
+            cout << "no baseline in " << baseline << ", recording one" << endl;
+            if (!newbaseline) newbaseline = baseline;
+        }
+        for (size_t i = 0; i < rows.size(); i++) {
+            if (!base.count(rows[i].name)) continue;
+            double b = base[rows[i].name];
+            if (rows[i].secs > (1 + threshold)*b && rows[i].secs - b > REGRESS_NOISE) {
+                printf("%-28s SLOWER: %.3f s, baseline %.3f s (+%.0f%%)\n", rows[i].name.c_str(),
+                        rows[i].secs, b, 100*(rows[i].secs/b - 1));
+                failed = true;
+            }
+        }
+    }
+
+    if (newbaseline) {
+        ofstream out(newbaseline);
+        char host[256] = "";
+        gethostname(host, sizeof(host)-1);
+        time_t now = time(NULL);
+        out << "# " << host << " " << ctime(&now);   // ctime ends in a newline
+        out << "# stage,seconds,rss_kb" << endl;
+        for (size_t i = 0; i < rows.size(); i++)
+            if (rows[i].ok) out << rows[i].name << "," << rows[i].secs << "," << rows[i].rss << endl;
+    }
+
+    cout << (failed ? "FAILED" : "passed") << endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,270 @@
+// Long-lived query server.  Answers sum 1/p queries from stdin, or from
+// clients of a Unix socket, without rebuilding its tables every time:
+// the phi_s tables and the Mobius table of phi_o are kept and only grow
+// to fit the largest x seen so far, and the primes come from the shared
+// prime table cache (Primecache).
+//
+// One request per line, one reply line per request:
+//    sum x          ->  sum x total
+//    parts x        ->  parts x phi_s phi_o rest
+//    crossover y    ->  crossover y p   (p the first prime with sum 1/p > y)
+//    quit           ->  (closes the connection, or stops reading stdin)
+// Anything else gets "error <line>", as do x outside [8, XMAX] and y
+// outside [1/2, the least the sum can be at XMAX], whose crossover could
+// be past XMAX.
+//
+// Requests that arrive together (within BATCHWAIT of each other, from any
+// client) are answered together: all their x, and the x+ of every
+// crossover, go through one batched phi_s/phi_o/S2 sweep, and the parts
+// and endgame sieves run concurrently on a Stagepool.
+//
+// Usage: server [-s socketpath] [-t threads]
+
+#include "utility.h"
+#include "special.cpp"
+#include "ordinary.cpp"
+#include "S2.cpp"
+#include "sinterval.cpp"
+#include "endgame.cpp"
+#include "blocksieve.cpp"
+#include "pipeline.cpp"
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+#define BATCHWAIT 20  // ms to wait for more requests before starting a batch
+#define XMAX ((lll)10000000000LL * 1000000000000LL)  // 10^22, as far as lll x goes (utility.h)
+
+struct Client {    // where the replies go
+    int fd;
+    mutex lock;
+    Client(int f) : fd(f) {}
+    ~Client() { if (fd > 1) close(fd); }
+    void reply(const string &s) {
+        lock_guard<mutex> g(lock);
+        string line = s + "\n";
+        for (size_t n = 0; n < line.size(); ) {
+            ssize_t w = write(fd, line.data() + n, line.size() - n);
+            if (w <= 0) return;   // client went away
+            n += w;
+        }
+    }
+};
+
+struct Request {
+    string line;
+    shared_ptr<Client> client;
+};
+
+deque<Request> pending;
+mutex pending_lock;
+condition_variable pending_cv;
+int readers = 0;   // input streams still open
+
+void submit(const string &line, shared_ptr<Client> client) {
+    lock_guard<mutex> g(pending_lock);
+    Request r = { line, client };
+    pending.push_back(r);
+    pending_cv.notify_one();
+}
+
+void reader_done() {
+    lock_guard<mutex> g(pending_lock);
+    readers--;
+    pending_cv.notify_one();
+}
+
+// Reads requests from fd until EOF or quit
+void read_requests(int fd, shared_ptr<Client> client) {
+    FILE *in = fdopen(dup(fd), "r");
+    char buf[4096];
+    while (in != NULL && fgets(buf, sizeof(buf), in) != NULL) {
+        string line(buf);
+        while (!line.empty() && (line[line.size()-1] == '\n' || line[line.size()-1] == '\r'))
+            line.erase(line.size()-1);
+        if (line == "quit") break;
+        if (!line.empty()) submit(line, client);
+    }
+    if (in != NULL) fclose(in);
+    reader_done();
+}
+
+bool isNumber(const string &s, bool point) {
+    if (s.empty()) return false;
+    for (size_t i = 0; i < s.size(); ++i)
+        if ((s[i] < '0' || s[i] > '9') && !(point && s[i] == '.'))
+            return false;
+    return true;
+}
+
+// x for sum and parts: digits only, 8 <= x <= XMAX
+bool getx(const string &s, lll &x) {
+    if (!isNumber(s, false)) return false;
+    size_t i = s.find_first_not_of('0');
+    if (i != string::npos && s.size() - i > 23) return false;   // to_lll would overflow
+    x = to_lll(s.c_str());
+    return x >= 8 && x <= XMAX;
+}
+
+// y for crossover, if its Schoenfeld interval ends by XMAX
+bool gety(const string &s, ftype &y, lll &xlo, lll &xhi) {
+    if (!isNumber(s, true)) return false;
+    y = to_ftype(s.c_str());
+    if (y < to_ftype(0.5) || y >= get_value(to_ftype(XMAX), true)) return false;
+    schoenfeld_interval(y, xlo, xhi);
+    xhi += (30 - xhi%30);
+    return xhi <= XMAX;
+}
+
+string str(ftype v) {
+    ostringstream os;
+    os << v;
+    return os.str();
+}
+
+string str(lll v) {
+    ostringstream os;
+    os << v;
+    return os.str();
+}
+
+// What a crossover query needs between the sweep and its reply
+struct Crossing {
+    ftype y;
+    lll xlo, xhi;
+    EG_blocks blocks;
+};
+
+void answer(vector<Request> &batch, unsigned nthreads) {
+    vector<string> kind(batch.size()), arg(batch.size());
+    vector<lll> xs;
+    map<size_t, Crossing> crossings;   // by request
+    for (size_t i = 0; i < batch.size(); i++) {
+        istringstream is(batch[i].line);
+        string extra;
+        lll x;
+        Crossing c;
+        is >> kind[i] >> arg[i];
+        if (is >> extra) kind[i] = "";
+        if ((kind[i] == "sum" || kind[i] == "parts") && getx(arg[i], x))
+            xs.push_back(x);
+        else if (kind[i] == "crossover" && gety(arg[i], c.y, c.xlo, c.xhi)) {
+            crossings[i] = c;
+            xs.push_back(c.xhi);
+        }
+        else kind[i] = "";
+    }
+
+    sort(xs.begin(), xs.end());
+    xs.erase(unique(xs.begin(), xs.end()), xs.end());
+
+    vector<ftype> special, ordinary, rest;
+    Stagepool pool;
+    pool.add("phi_s", [&]{ phi_s(xs, special); });
+    for (auto &c : crossings) {
+        Crossing *cp = &c.second;
+        pool.add("endgame sieve", [cp]{ schofeld_sieve(cp->blocks, cp->xlo, cp->xhi); });
+    }
+    pool.add("S2", [&]{ sum1p_and_s2_m1(xs, rest); });
+    pool.add("phi_o", [&]{ phi_o(xs, ordinary); });
+    if (!xs.empty()) {
+        pool.run(nthreads);
+        pool.report(cerr);
+    }
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        set_output_precision(30);   // find_crossover sets its own
+        if (kind[i] == "") {
+            batch[i].client->reply("error " + batch[i].line);
+            continue;
+        }
+        lll x = kind[i] == "crossover" ? crossings[i].xhi : to_lll(arg[i].c_str());
+        size_t j = lower_bound(xs.begin(), xs.end(), x) - xs.begin();
+        ftype total = special[j] + ordinary[j] + rest[j];
+        if (kind[i] == "sum")
+            batch[i].client->reply("sum " + arg[i] + " " + str(total));
+        else if (kind[i] == "parts")
+            batch[i].client->reply("parts " + arg[i] + " " + str(special[j]) + " "
+                    + str(ordinary[j]) + " " + str(rest[j]));
+        else {
+            Crossing &c = crossings[i];
+            lll block_crossover = schofeld_scan(total, c.y, c.blocks);
+            lll p = find_crossover(total, c.y, c.xlo, block_crossover);
+            batch[i].client->reply("crossover " + arg[i] + " " + str(p));
+        }
+    }
+}
+
+void usage(char *name) {
+    printf("Usage: %s [-s socketpath] [-t threads]\n", name);
+    printf("  reads requests from stdin, or from clients of socketpath\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL;
+    unsigned nthreads = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-s") && i+1 < argc) path = argv[++i];
+        else if (!strcmp(argv[i], "-t") && i+1 < argc) nthreads = atoi(argv[++i]);
+        else { usage(argv[0]); return 1; }
+    }
+
+    phi_s_keep = true;
+
+    if (path == NULL) {
+        readers = 1;
+        thread(read_requests, 0, make_shared<Client>(1)).detach();
+    }
+    else {
+        int s = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+        unlink(path);
+        if (s < 0 || bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(s, 16) < 0) {
+            perror(path);
+            return 1;
+        }
+        readers = 1;   // the listener counts as one, so we never stop
+        thread([s]{
+            for (;;) {
+                int fd = accept(s, NULL, NULL);
+                if (fd < 0) continue;
+                { lock_guard<mutex> g(pending_lock); readers++; }
+                thread(read_requests, fd, make_shared<Client>(fd)).detach();
+            }
+        }).detach();
+    }
+
+    for (;;) {
+        vector<Request> batch;
+        {
+            unique_lock<mutex> g(pending_lock);
+            pending_cv.wait(g, []{ return !pending.empty() || readers == 0; });
+            if (pending.empty()) break;    // all input closed
+            // give requests sent together a moment to arrive
+            g.unlock();
+            this_thread::sleep_for(chrono::milliseconds(BATCHWAIT));
+            g.lock();
+            batch.assign(pending.begin(), pending.end());
+            pending.clear();
+        }
+        answer(batch, nthreads);
+    }
+
+    return 0;
+}
@@ -1,54 +1,126 @@
 // Estimates lower and upper bounds on the Schoenfeld interval.
-// This is accomplished by binary searching for z in the equation log(log(z)) + C +- err
-// Where err is the error term that upper and lower bounds sum 1/p
-// This only works when x is <= 10^100 (anything higher is impractical), and is done
-// With a special feq method that uses absolute and relative error.
+// We solve log(log(z)) + C +- err(z) = y for z by Newton's method in
+// u = log(log(z)), where err(z) bounds |sum 1/p - log log z - C| for p <= z.
+// err is the smaller of
+//    Schoenfeld (RH):  (3 log z + 4) / (8 pi sqrt z)          z >= 13.5
+//    Dusart (2010):    1/(10 log^2 z) + 4/(15 log^3 z)         z >= 10372
+// Dusart's bound is unconditional and is the sharper one below about 10^7.
+// Below 10372 we just add up 1/p, which pins the crossover exactly.
+//
+// If a previous run gives the exact sum s0 at some z0, the Brun-Titchmarsh
+// inequality pi(z0+h) - pi(z0) <= 2h/log h (Montgomery-Vaughan) bounds how
+// fast the sum can move away from s0, which cuts the interval from one side.
 
 #include "utility.h"
 #include <iostream>
 #include <cmath>
 
+#include "Primelist.h"
+
 #define C 0.261497212847642783755426838609
-#define E 4
+#define SI_DUSART 10372     // Dusart's bound holds from here on
 
 using namespace std;
-using namespace NTL;
-
-const double EPS_ABS = 1e-10;
-const double EPS_REL = 1e-10;
 
-// Returns true if ftype a and b are within an absolute or relative error of 1e-10
-bool feq(ftype a, ftype b) {
-    ftype d = fabs(b-a);
-    if (d <= EPS_ABS) return true;
-    if (d <= max(fabs(a),fabs(b))*EPS_REL) return true;
-    return false;
+// Bound on |sum 1/p - log log z - C|, and its derivative in u = log log z
+ftype get_err(ftype z, ftype &derr) {
+    ftype L = log(z);
+    ftype rh = (3*L+4) / (8*M_PI*sqrt(z));
+    ftype du = (2-3*L)*L / (16*M_PI*sqrt(z));    // d rh/du = z log z d rh/dz
+    if (z >= SI_DUSART) {
+        ftype L2 = L*L, L3 = L2*L;
+        ftype dusart = 1/(10*L2) + 4/(15*L3);
+        if (dusart < rh) {
+            derr = -1/(5*L2) - 4/(5*L3);
+            return dusart;
+        }
+    }
+    derr = du;
+    return rh;
 }
 
 // Returns an upper and lower bound for the sum 1/p p <= z
 ftype get_value(ftype z, bool lower) {
-    ftype err = (3*log(z)+4) / (8*M_PI*sqrt(z));
+    ftype derr;
+    ftype err = get_err(z, derr);
     return log(log(z)) + C + (lower ? err : -err);
 }
 
-// Binary searches for lower and upper bounds on z in sum 1/p p <= z = y
-ftype find_z(ftype y, bool lower) {
-    ftype lo = to_ftype(0.0);
-    ftype hi = to_ftype(1e100);
-
-    while (!feq(lo, hi)) {
-        ftype z = (hi+lo) / 2;
-        ftype value = get_value(z, lower);
-        if (value > y) {
-            hi = z;
-        }
-        else {
-            lo = z;
+// Exact crossover for small y: the first prime p with sum 1/p up to p > y,
+// or 0 if that is beyond SI_DUSART.  prev gets the prime before p (1 for
+// p = 2).
+long small_crossover(ftype y, long *prev = NULL) {
+    Primelist P(SI_DUSART);
+    ftype sum = to_ftype(0);
+    for (long i = 0; i < P.length(); i++) {
+        sum += 1/to_ftype(P[i]);
+        if (sum > y) {
+            if (prev) *prev = i ? P[i-1] : 1;
+            return P[i];
         }
     }
+    return 0;
+}
 
-    if (lower)  // E term necessary for small crossovers. Won't have performance impact for large
-        return lo-E;
+// Solves for lower and upper bounds on z in sum 1/p p <= z = y.  Below
+// SI_DUSART they are the crossover and the prime before it, so the final
+// search (find_crossover) still has a prime below the crossing in range.
+ftype find_z(ftype y, bool lower) {
+    long prev, p = small_crossover(y, &prev);
+    if (p) return to_ftype(lower ? prev : p);
+
+    ftype u = y - C;    // log log z, ignoring err
+    for (int it = 0; it < 50; it++) {
+        ftype z = exp(exp(u));
+        ftype derr;
+        ftype err = get_err(z, derr);
+        ftype f = u + C + (lower ? err : -err) - y;
+        ftype step = f / (1 + (lower ? derr : -derr));
+        u -= step;
+        if (fabs(step) < 1e-28) break;
+    }
+
+    // the bounds only hold from SI_DUSART on, where small_crossover stops
+    ftype z = exp(exp(u));
+    if (z < SI_DUSART) z = SI_DUSART;
+    if (lower)  // one unit of slack for the rounding in exp(exp(u))
+        return z-1;
     else
-        return hi+E;
+        return z+1;
+}
+
+// Smallest h > 1 with 2h/(z0 log h) >= d, i.e. the sum can't move by d
+// within h of z0 (Brun-Titchmarsh, with each 1/p <= 1/z0)
+long long bt_reach(ftype d, lll z0) {
+    double w = ftod(d) * (double)z0 / 2;      // want h/log h >= w
+    double h = max(w, 3.0);
+    for (int it = 0; it < 100; it++) {
+        double hn = w * log(h);
+        if (fabs(hn - h) < 0.5) break;
+        h = hn;
+    }
+    while (h > 3 && (h-1)/log(h-1) >= w) h--;
+    while (h/log(h) < w) h++;
+    return (long long)h;
+}
+
+// Schoenfeld interval [xlo, xhi] for the crossover of y.  If s0 = sum 1/p
+// for p <= z0 is known from an earlier run, pass it to shrink the interval.
+void schoenfeld_interval(ftype y, lll &xlo, lll &xhi,
+        lll z0 = 0, ftype s0 = to_ftype(0)) {
+    xlo = ftolll(floor(find_z(y, true)));
+    xhi = ftolll(ceil(find_z(y, false)));
+    if (z0 <= 2) return;
+
+    if (s0 <= y) {  // crossover is past z0 + h
+        long long h = bt_reach(y - s0, z0);
+        if (z0 + h - 1 > xlo) xlo = z0 + h - 1;
+    }
+    else {          // crossover is at or before z0 - h
+        long long h = bt_reach(s0 - y, z0);
+        // the primes below z0 are larger reciprocals: 1/p < 1/(z0-h)
+        while (h > 2 && (h >= z0 || to_ftype(2.0*h/log((double)h)) / to_ftype(z0 - h) >= s0 - y)) h--;
+        if (h > 2 && z0 - h < xhi) xhi = z0 - h;
+    }
+    if (xlo > xhi) xlo = xhi;
 }
@@ -117,6 +117,10 @@
 #include <stdio.h>
 #include <iostream>
 #include <cmath>
+#include <cstring>
+#include <vector>
+#include <memory>
+#include <mutex>
 
 #include "Primelist.h"
 
@@ -125,112 +129,229 @@
 #include "RangeArray.h"
 
 using namespace std;
-using namespace NTL;
 
-double mhat = 1;
+// Length of the phi_s segments.  It used to be x^(1/3), which makes the
+// RangeArray outgrow the cache once x passes 10^15 or so.  By default it
+// is still x^(1/3), but at most PHI_S_SEGLEN (a degree-4 tree of that
+// size fits in a 1 MB L2); set seglen, or PHI_S_SEGLEN in the environment,
+// to fix it.  Results don't depend on it.
+#ifndef PHI_S_SEGLEN
+#define PHI_S_SEGLEN 131072
+#endif
+
+long long seglen = 0;  // 0: the default above, or the environment
+
+// Largest table of prime reciprocal sums for the easy leaves (16 bytes
+// per 240 integers, so 270 MB at this size)
+#ifndef PHI_S_EASYMAX
+#define PHI_S_EASYMAX 4000000000L
+#endif
+
+long phi_s_easymax = 0;  // 0: PHI_S_EASYMAX; the planner sets it to fit a memory budget
+
+// A segment's tree is lazy (RangeArray.h) while the last segment had fewer
+// than this many special nodes per unit of tree degree; each prefix then
+// costs about size/degree adds, against depth-2 per sifted leaf saved
+#ifndef PHI_S_LAZY
+#define PHI_S_LAZY 4
+#endif
+
+long long phi_s_seglen(double x13) {
+    if (seglen > 0) return seglen;
+    const char *s = getenv("PHI_S_SEGLEN");
+    if (s && atoll(s) > 0) return atoll(s);
+    return max(min((long long)x13, (long long)PHI_S_SEGLEN), 1LL);
+}
 
-// table of mhat values for the x we are testing
-// these seem to be very close to x^(1/6)
+// Activity windows.  The special nodes of b are (x/m, b) with m = m' q,
+// q = p_{b+1}, m' odd squarefree with all its factors above q, and
+// m > x^(1/3).  The walk down m' meets them in increasing x/m, so b's
+// last node is the one with the smallest such m', and b is done after
+// the segment holding x/(m' q).  Past that, C[b] isn't needed; q still
+// has to be sifted out while any larger b has nodes to come.
 //
-//   10^3      5
-//   10^6     13
-//   10^9     33
-//   10^12   103
-//   10^15   319
-//   10^18  1005
+// mhat is the smallest m' over all b.  It used to come from a table by
+// decade (x^(1/6) or so: 5, 13, 33, 103, 319, 1005 for 10^3 .. 10^18),
+// with the cutoff q > x/(mhat lo) the same for every b; that kept early
+// b sifting long after their nodes were done, and was loose between decades.
 //
-//   5177717 15
-//   1801241484456448000 1105
-//      for this "target" value final b = 2^21 = 2097152
-void set_mhat(long long x) {
-    if (x < 1000)
-        mhat = 1;
-    else if (x < 1000000)
-        mhat = 5;
-    else if (x < 1000000000)
-        mhat = 13;
-    else if (x < 1000000000000LL)
-        mhat = 33;
-    else if (x < 1000000000000000LL)
-        mhat = 103;
-    else if (x < 1000000000000000000LL)
-        mhat = 319;
-    else
-        mhat = 1005;
+// Fills last[b] for b <= a-2 (-1 if b has no nodes) and returns mhat.
+long phi_s_windows(lll x, long long x13, long a, const Primelist &P,
+                   const unsigned int *Mprimetable, long long L, vector<long long> &last)
+{
+    long mhat = 0, m13 = (long)x13;   // m' <= x^(1/3), where the walk starts
+    last.assign(a > 1 ? a-1 : 1, -1);
+    for (long b=1;b<=a-2;b++) {
+        long q = P[b];
+        long mprime = max((long)(x13/q), 1L);
+        while (mprime <= m13 && (Mprimetable[mprime] <= (unsigned long)q || (long long)mprime*q <= x13))
+            mprime++;
+        if (mprime > m13) continue;
+        last[b] = (long long)(x/((lll)mprime*q)/L);
+        if (mhat == 0 || mprime < mhat) mhat = mprime;
+    }
+    return mhat;
 }
 
-// Returns the contribution of special nodes for sum 1/p for all p <= x
-ftype phi_s(long long x)  // transliteration of maple code in psum.m
-{                        // however we will compute a rather than bring it in
-    set_mhat(x);
-    long a; 
-    long i;
+// The tables phi_s builds: primes, Mobius function and smallest prime
+// factors up to x^(1/3), and the prime weight sums for the easy leaves.
+// They serve any smaller x too, so with phi_s_keep set (by server.cpp,
+// say) the largest set built so far is kept for later calls and only
+// rebuilt when an x outgrows it.
+template <class W>
+class phi_s_tables
+{
+    public:
+        long n13;             // covers m <= n13
+        Primelist P;
+        Primeindex I;         // pi over the same range
+        Mulist M;             // table of Mobius function (computed correctly)
+        unsigned int *Mprimetable;   // smallest prime factor for odd squarefree numbers
+        Primesums<W> E;
+
+        phi_s_tables(long n, long easymax) : n13(n), P(n), I(n), M(n), E(easymax) {
+            long i;
+            LOG(SP, DEBUG) << "M done.";
+            Spflist S(n); // table of smallest prime factor
+            LOG(SP, DEBUG) << "S done.";
+            Mprimetable = Arena::make<unsigned int>(n+1);
+            Mprimetable[1] = 1;
+            for (i=2;i<=n;i++) {
+                if (M.mu(i) && (i%2)) {
+                    Mprimetable[i] = S.spf(i);
+                }
+                else Mprimetable[i] = 0;
+            }
+            LOG(SP, DEBUG) << "Mprimetable done.";
+        }
 
-    double x13; // exact cube root of x
-    x13 = pow((double)x, 1.0/3);
+        ~phi_s_tables() { Arena::release(Mprimetable, n13+1); }
+};
+
+bool phi_s_keep = false;            // keep the tables between calls
+mutex phi_s_warm_lock;
+
+template <class W>
+shared_ptr<phi_s_tables<W> > get_phi_s_tables(long n13, long easymax)
+{
+    static shared_ptr<phi_s_tables<W> > phi_s_warm;   // one set per weight
+    lock_guard<mutex> g(phi_s_warm_lock);
+    shared_ptr<phi_s_tables<W> > w = phi_s_warm;
+    if (w && w->n13 >= n13 && w->E.size() >= easymax) return w;
+    if (w && phi_s_keep) {  // grow both, so neither shrinks
+        n13 = max(n13, w->n13);
+        easymax = max(easymax, w->E.size());
+    }
+    w = make_shared<phi_s_tables<W> >(n13, easymax);
+    if (phi_s_keep) phi_s_warm = w;
+    return w;
+}
 
-    double x23; // used for some bounds so we may as well compute it now
-    x23 = (double)x13*x13;
+// Per-target state for phi_s.  Several x can share one sweep: the
+// leaves below each segment, C[b], don't depend on x, so the segments
+// are those of the largest x and every target picks its special nodes
+// out of them.
+template <class W>
+struct phi_s_target {
+    lll x;
+    long long x13;     // floor of the cube root of x
+    long mhat;         // smallest m' of a special node
+    vector<long long> last;   // last segment with a node of b, see phi_s_windows
+    long a;            // number of primes <= x13
+    long *Nextmprime;
+    typename W::value totalpos, totalneg, total;
+    long long specialcount;
+};
+
+// What phi_s hands the primes to when it is also doing S2's sweep (see
+// S2_fused in S2.cpp): step(p) for every prime in increasing order, until
+// done().  This one takes none.
+struct phi_s_nofuse {
+    void step(long long) {}
+    bool done() const { return true; }
+};
+
+// Computes the contribution of special nodes for sum W::leaf(p) for all
+// p <= x, for every x in xs (sorted, increasing), into result.  With fuse,
+// each segment is also sieved the rest of the way (by the primes up to
+// the square root of its end that it wasn't sifted by), and its primes go
+// to fuse, after those of P.
+template <class W, class Fuse = phi_s_nofuse>
+void phi_s_w(const vector<lll> &xs, vector<typename W::value> &result, Fuse *fuse = NULL)
+{                        // transliteration of maple code in psum.m
+    static_assert(W::multiplicative, "phi_s needs a multiplicative weight");
+    typedef typename W::value value;
+    PERF_REGION("phi_s");
+    long a;              // however we will compute a rather than bring it in
+    long i, j;
+    long ntarget = xs.size();
+    result.assign(ntarget, W::zero());
+    if (ntarget == 0) return;
+
+    lll x = xs[ntarget-1];   // largest x sets up the tables
+
+    long long x13 = icbrt(x);   // exact: m > x^(1/3) iff m > x13
+
+    // Easy leaves: a node (y, b) with y < p_{b+1}^2 has only 1 and the
+    // primes in (p_b, y] left after sieving by p_1..p_b, so its value is
+    // f(1) + sum f(p) over those primes, which Primesums gives in O(1).
+    // Every easy y is below sqrt x (y < x/q^2 and y < q^2), and a segment
+    // only needs sieving by q while it can hold hard leaves (y >= q^2).
+    // The table is capped at PHI_S_EASYMAX; nodes past it stay hard.
+    long n13 = x13;
+    long easymax = (long)min(sqrtl((long double)x), (long double)(phi_s_easymax > 0 ? phi_s_easymax : PHI_S_EASYMAX));
+    if (easymax < n13+1) easymax = n13+1;
+    shared_ptr<phi_s_tables<W> > tables;
+    {
+        PERF_REGION("phi_s tables");   // here, so P, M and E count too
+        tables = get_phi_s_tables<W>(n13, easymax);
+    }
+    Primelist &P = tables->P;
+    Primeindex &I = tables->I;
+    Mulist &M = tables->M;
+    unsigned int *Mprimetable = tables->Mprimetable;
+    Primesums<W> &E = tables->E;
+    easymax = E.size();   // may be larger, if the tables were kept
 
-    Primelist P((long long)(x13+EP));
-    a = P.length();
 #define nthprime(x) P[(x)-1]  // since P[0] = 2, P[1] = 3, etc.
-    long pa;   // a-th prime
-    pa = nthprime(a);
+    a = I.pi(n13);
 
     cerr << setprecision(18);
-    quad_float::SetOutputPrecision(30);
-
-    if (DEBUG_SP) {
-        cerr << "x = " << x << endl;
-        cerr << "x13 = " << x13 << endl;
-        cerr << "x23 = " << x23 << endl;
-        cerr << "a = " << a << endl;
-        cerr << "pa = " << pa << endl;
+    set_output_precision(30);
+
+    vector<phi_s_target<W> > T(ntarget);
+    for (j=0;j<ntarget;j++) {
+        phi_s_target<W> &t = T[j];
+        t.x = xs[j];
+        t.x13 = icbrt(t.x);
+        t.a = min(a, I.pi(t.x13));
+        t.Nextmprime = new long[a > 1 ? a-1 : 1];
+        for (long b=1;b<=t.a-2;b++) t.Nextmprime[b] = t.x13;
+        t.totalpos = W::zero(); t.totalneg = W::zero(); t.total = W::zero();
+        t.specialcount = 0;
+
+        LOG(SP, DEBUG) << "x = " << t.x << ", x13 = " << t.x13
+                       << ", a = " << t.a << ", pa = " << (t.a ? nthprime(t.a) : 0);
     }
 
-    ftype *C;  // cumulative sum array
+    value *C;  // cumulative sum array
     long b;    // index for primes
-    C = new ftype[a-1];
-    for (b=1;b<=a-2;b++) C[b] = 0;
-    if (DEBUG_SP)
-        cerr << "C done." << endl; 
-
-    Mulist M((int)(x13+1-EP)); // table of Mobius function (computed correctly)
-    
-    if (DEBUG_SP)
-        cerr << "M done." << endl; 
-    Spflist S((int)(x13+1-EP)); // table of smallest prime factor
-    
-    if (DEBUG_SP)
-        cerr << "S done." << endl; 
-
-    long *Mprimetable; // lists smallest prime factor for odd squarefree numbers
-    Mprimetable = new long[(int)(x13+1+EP)];
-    Mprimetable[1] = 1;
-    for (i=2;i<=x13+EP;i++) {
-        if (M.mu(i) && (i%2)) {
-            Mprimetable[i] = S.spf(i);
-        }
-        else Mprimetable[i] = 0;
-    }
-
-    if (DEBUG_SP)
-        cerr << "Mprimetable done." << endl; 
+    C = new value[a > 1 ? a-1 : 1];
+    for (b=1;b<=a-2;b++) C[b] = W::zero();
+    LOG(SP, DEBUG) << "C done.";
 
     long long Mchek;
     Mchek = 0;
-    for (i=1;i<=x13+EP;i++) Mchek += Mprimetable[i];
+    for (i=1;i<=x13;i++) Mchek += Mprimetable[i];
     
-    if (DEBUG_SP)
-        cerr << "Mprimetable check sum = " << Mchek << endl; 
+    LOG(SP, DEBUG) << "Mprimetable check sum = " << Mchek;
 
-    long *Nextmprime;
-    Nextmprime = new long[a-1];
-    for (b=1;b<=a-2;b++) Nextmprime[b] = x13;
-    
-    if (DEBUG_SP)
-        cerr << "Nextmprime done." << endl; 
+    value *Sb = new value[a > 1 ? a-1 : 1];  // sum f(p) for p <= p_b
+    for (b=1;b<=a-2;b++) Sb[b] = E.sum(nthprime(b));
+    const value one = W::leaf(1);
+#define easyphi(y, b) ((y) >= nthprime(b) ? one + E.sum(y) - Sb[b] : ((y) >= 1 ? one : W::zero()))
+
+    LOG(SP, DEBUG) << "Primesums up to " << easymax << " done.";
 
     // include if you want the node count map
     // long *Nodecount; Nodecount = new long[a-1];
@@ -240,122 +361,175 @@ ftype phi_s(long long x)  // transliteration of maple code in psum.m
     long k, mprime, q;  // as in the paper
     long long m;
 
+    long long L = phi_s_seglen(x13);   // segment length
     long long lo; // beginning of segment k
-    long long specialcount; 
-    long countthisk, countthisb;
-    double bound;
-    ftype totalpos, totalneg, total, thisnode, term;
+    long countthisk = 0, countthisb = 0;
+    value thisnode, term;
+
+    // every node value x/m is at most x/(x13+1), since m > x13
+    long long nseg = xdiv(x, x13+1)/L + 1;
+
+    // last segment in which b has nodes for some target (lastnode), and
+    // in which q = p_{b+1} has to be sifted out (lastsift: b or any larger b
+    // still has nodes)
+    vector<long long> lastnode(a > 1 ? a-1 : 1, -1), lastsift(a > 1 ? a : 2, -1);
+    for (j=0;j<ntarget;j++) {
+        phi_s_target<W> &t = T[j];
+        t.last.assign(a > 1 ? a-1 : 1, -1);
+        t.mhat = phi_s_windows(t.x, t.x13, t.a, P, Mprimetable, L, t.last);
+        for (b=1;b<=t.a-2;b++) lastnode[b] = max(lastnode[b], t.last[b]);
+        LOG(SP, DEBUG) << "x = " << t.x << ": mhat = " << t.mhat;
+    }
+    for (b=a-2;b>=1;b--) lastsift[b] = max(lastsift[b+1], lastnode[b]);
+    long long progress = max(nseg/100, 1LL);  // report about 100 times
 
-    totalpos = 0; totalneg = 0; total = 0;
+    // with one target, nothing up to x^(1/3) is a special node, so we
+    // just sieve there; smaller targets can have nodes anywhere
+    long long nodestart = ntarget == 1 ? x13+1 : 0;
+    deg = 4;
 
-    specialcount = 0;
+    // progress by segments; the early ones hold more special nodes, so
+    // the ETA starts out high and comes down
+    Progress &pr = Progress::start("phi_s", "segment", "special nodes");
+    long long nodesdone = 0;
 
-    lo = 0;
-    deg = 2097152; // segment 0 has no special nodes so we just sieve
+    // for fuse: the segment each P[i] was last sifted out of, and the
+    // segment's flags, to finish sieving
+    vector<long long> siftedin(fuse ? P.length() : 0, -1);
+    vector<char> rest(fuse ? L : 0);
+    if (fuse) for (i=0; i<P.length() && !fuse->done(); i++) fuse->step(P[i]);
 
-    for (k=0; k<=x13+EP;k++) {
+    for (k=0; k<nseg; k++) {
+        PERF_REGION("phi_s segment");
 
-        lo = (long long)(k*x13+EP);
+        lo = k*L;
+        long long hi = lo + L;
 
         // Efficiency not worth it here since we are in the outer loop
-        if (k==1) {
-            if (DEBUG_SP)
-                cerr << "Initial sift done." << endl;
+        bool lazy;  // see RangeArray.h: pays when prefixes are few
+        if (hi <= nodestart) { deg = 2097152; lazy = true; }
+        else if (lo <= nodestart) {
+            LOG(SP, DEBUG) << "Initial sift done.";
             deg = 4;
+            lazy = false;
+        }
+        else {
+            // the schedule was tuned on segments of length x^(1/3), so
+            // scale the last segment's node count to that length
+            double c = countthisk*(double)x13/(lo - max(lo-L, nodestart));
+            if (deg == 4 && c < 2000000) deg = 8;
+            if (deg == 8 && c < 100000) deg = 16;
+            if (deg == 16 && c < 50000) deg =  64;
+            if (deg == 64 && c < 10000) deg = 128;
+            if (deg == 128 && c < 1000) deg = 2048;
+            if (deg == 2048 && c <= 2) deg = 2097152;
+            lazy = countthisk < PHI_S_LAZY*deg;
         }
 
-        if (k>1 && deg == 4 && countthisk < 2000000) deg = 8;
-        if (k>1 && deg == 8 && countthisk < 100000) deg = 16;
-        if (k>1 && deg == 16 && countthisk < 50000) deg =  64;
-        if (k>1 && deg == 64 && countthisk < 10000) deg = 128;
-        if (k>1 && deg == 128 && countthisk < 1000) deg = 2048;
-        if (k>1 && deg == 2048 && countthisk <= 2) deg = 2097152;
-
-        long long hi = (long long)((k+1)*x13+EP);
-        RangeArray R(lo, hi-lo, deg);
+        RangeArrayAnyT<W> R(lo, hi-lo, deg, lazy);  // shift/mask version for this degree
         
-        if (DEBUG_SP) {
-            cerr << "lo: " << lo << " hi: " << hi << endl;
-            cerr << "RangeArray R(" << lo << ", " << hi-lo << ", " << deg << ");" << endl;
-        }
+        LOG(SP, TRACE) << "RangeArray R(" << lo << ", " << hi-lo << ", " << deg << ")" << (lazy ? ", lazy" : "");
 
         countthisk = 0;
 
         // clear node count map
         // for (b=1;b<=a-2;b++) Nodecount[b] = 0;
 
-        for (b=1;b<=a-2;b++) {
-
-            countthisb = 0;
+        for (b=1;b<=a-2 && k<=lastsift[b];b++) {
 
             q = nthprime(b+1);
-            if (q > (x23+EP)/(mhat*k)) break; // all done with this k
-
 
-            bound = (1.0/hi)*x/q;
-            
-            if (DEBUG_SP)
-                cerr << "bound: " << bound << endl;
-
-            mprime = Nextmprime[b];
-            while (mprime > bound) {  
-
-                if (Mprimetable[mprime] > q) {
-
-                    m = (long long) mprime*q;
-
-                    // this check becomes necessary because hi may be higher than we actually want to go,
-                    // due to the rounding issues when x is not a perfect cube
-                    if (m > x13 +EP) {
-
-                        countthisk++;
-                        countthisb++;
-
-                        // bump node count map
-                        // Nodecount[b]++ ;
-                        
-                        long long spot = x/m-lo;
-                        ftype prefix = R.prefix(spot);
-
-                        // also include to see other terms included in the paper
-                        if (DEBUG_SP)
-                            cerr << "R.prefix(" << spot << ") = " << prefix << endl;
-
-                        thisnode = C[b] + prefix;
-
-                        if (DEBUG_SP)
-                            cerr << "C[b]: " << C[b] << endl;
-                        
-                        // include if you want a list of special nodes
-                        if (DEBUG_SP) {
-                            cerr << "special node " ;
-                            cerr << "(" << x << "/" << m << ", " << b << ") = " << thisnode << endl;
+            // leaves below hardlim are easy; the tree is only needed (and
+            // sieved by q) while this segment can hold a hard leaf
+            long long hardlim = min((long long)q*q, (long long)easymax+1);
+            bool hard = hardlim < hi && (lll)q*q*lo < x;
+            bool active = k <= lastnode[b];   // else only sift
+            if (hard && active && hardlim >= lo)  // first segment with hard leaves for b
+                C[b] = easyphi(lo-1, b);
+
+            for (j=0;j<ntarget && active;j++) {
+                phi_s_target<W> &t = T[j];
+                if (b > t.a-2 || k > t.last[b]) continue;   // all done for this target
+
+                countthisb = 0;
+
+                // node (x/m, b) is in this segment iff x/m < hi; test it
+                // in integers, since x/hi/q in doubles can round across m
+                mprime = t.Nextmprime[b];
+                while (t.x < (lll)hi*mprime*q) {
+
+                    if (Mprimetable[mprime] > q) {
+
+                        m = (long long) mprime*q;
+
+                        // hi may be higher than we actually want to go, so
+                        // check that m is still past the cube root
+                        if (m > t.x13) {
+
+                            countthisk++;
+                            countthisb++;
+
+                            // bump node count map
+                            // Nodecount[b]++ ;
+                            
+                            long long y = xdiv(t.x, m);
+                            if (y < hardlim)
+                                thisnode = easyphi(y, b);
+                            else {
+                                long long spot = y-lo;
+                                value prefix = R.prefix(spot);
+
+                                // also include to see other terms included in the paper
+                                LOG(SP, TRACE) << "R.prefix(" << spot << ") = " << prefix;
+
+                                thisnode = C[b] + prefix;
+
+                                LOG(SP, TRACE) << "C[b]: " << C[b];
+                            }
+                            
+                            // include if you want a list of special nodes
+                            LOG(SP, TRACE) << "special node (" << t.x << "/" << m << ", " << b << ") = " << thisnode;
+
+                            term = W::scale(thisnode, m);
+
+                            if (M.mu(mprime) > 0) {
+                                t.totalneg += term;
+                                t.total -= term;
+                            }
+                            else {
+                                t.totalpos += term;
+                                t.total += term;
+                            }
+                            t.specialcount++;
                         }
+                    }
 
-                        term = thisnode/m;
+                    mprime--;  // iterating thru odds makes very little difference
 
-                        if (M.mu(mprime) > 0) {
-                            totalneg += term;
-                            total -= term;
-                        }
-                        else {
-                            totalpos += term;
-                            total += term;
-                        }
-                    }
                 }
 
-                mprime--;  // iterating thru odds makes very little difference
-
+                t.Nextmprime[b] = mprime;
             }
+            if (!hard) continue;  // nor for any larger b, so no more sieving
 
-            Nextmprime[b] = mprime;
-
-            C[b] += R.total();
-            if (DEBUG_SP)
-                cerr << "R.sift(" << q << ");" << endl;
+            if (active) C[b] += R.total();
+            LOG(SP, TRACE) << "R.sift(" << q << ");";
             R.sift(q);
+            if (fuse) siftedin[b] = k;
+
+        }
 
+        if (fuse && !fuse->done()) {
+            PERF_REGION("phi_s S2");
+            memcpy(&rest[0], R.bits(), hi-lo);
+            for (i=1; i<P.length() && (long long)P[i]*P[i] < hi; i++) if (siftedin[i] != k) {
+                long long p = P[i], s = max(p*p, (lo+p-1)/p*p);
+                if (!(s & 1)) s += p;   // the evens are out already
+                for (s -= lo; s < L; s += 2*p) rest[s] = 0;
+            }
+            // primes up to P.max() are out of R, and were stepped already
+            for (long long t = max(lo, (long long)P.max()+1) | 1; t < hi && !fuse->done(); t += 2)
+                if (rest[t-lo]) fuse->step(t);
         }
 
         // include if you want a count of special nodes per segment
@@ -371,25 +545,48 @@ ftype phi_s(long long x)  // transliteration of maple code in psum.m
         // cerr << "   " << k << endl;
         // }
 
-        specialcount += countthisk;
-        cerr << "Segment " << k << " of " << (long long)(x13+EP) << " done." << endl;
+        nodesdone += countthisk;
+        pr.update((double)(k+1)/nseg, k+1, nseg, nodesdone);
+        if (k % progress == progress-1 || k == nseg-1) {
+            LOG(SP, INFO) << "Segment " << k+1 << " of " << nseg << " done, ETA "
+                          << Progress::hms(pr.eta()) << ".";
+        }
     }
+    pr.finish();
 
-    if (DEBUG_SP) {
-        cerr << "x = " << x << endl;
+    for (j=0;j<ntarget;j++) {
+        phi_s_target<W> &t = T[j];
+        LOG(SP, DEBUG) << "x = " << t.x << ": " << t.specialcount << " special nodes";
 
-        cerr << specialcount << " special nodes." << endl;
-
-        cerr << "LMO estimate = " << (double)a*a/2 << endl;
         // Note: this estimate is basically pairs p>q with p*q > x^(1/3)
+        LOG(SP, DEBUG) << "LMO estimate = " << (double)t.a*t.a/2
+                       << ", actual/estimate = " << t.specialcount/ ( (double)t.a*t.a/2 );
+
+        LOG(SP, DEBUG) << "total positive terms = " << t.totalpos;
+        LOG(SP, DEBUG) << "total negative terms = " << t.totalneg;
+        LOG(SP, DEBUG) << "               total = " << t.total;
+        LOG(SP, DEBUG) << "         discrepancy = " << t.total - (t.totalpos - t.totalneg);
+        result[j] = t.total;
+        delete[] t.Nextmprime;
+    }
 
-        cerr << "actual/estimate = " << specialcount/ ( (double)a*a/2 ) << endl;
+    delete[] C;
+    delete[] Sb;
+#undef easyphi
+#undef nthprime
+}
 
-        cerr << "total positive terms = " << totalpos << endl;
-        cerr << "total negative terms = " << totalneg << endl;
-        cerr << "               total = " << total << endl;
-        cerr << "         discrepancy = " << total - (totalpos - totalneg) << endl;
-    }
+// The same for sum 1/p
+void phi_s(const vector<lll> &xs, vector<ftype> &result)
+{
+    phi_s_w<Wrecip>(xs, result);
+}
 
-    return total;
+// Returns the contribution of special nodes for sum 1/p for all p <= x
+ftype phi_s(lll x)
+{
+    vector<lll> xs(1, x);
+    vector<ftype> result;
+    phi_s(xs, result);
+    return result[0];
 }
@@ -5,6 +5,6 @@ using namespace std;
 #define EP 1e-10
 
 int main() {
-    quad_float result = phi_s(8);
+    ftype result = phi_s(8);
     cout << result << endl;
 }
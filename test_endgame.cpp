@@ -4,7 +4,6 @@
 #include "blocksieve.cpp"
 
 using namespace std;
-using namespace NTL;
 
 void prime_counts(long long start, long long xint, int nbloks) {
     for (int i = 0; i < nbloks; ++i) {
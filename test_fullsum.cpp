@@ -2,9 +2,14 @@
 #include <iostream>
 #include <cmath>
 #include <iomanip>
-#include "special.cpp"
-#include "ordinary.cpp"
-#include "S2.cpp"
+#include <cstring>
+#include "batch.cpp"
+
+// Usage: test_fullsum x [-single | -batch]
+// prints the naive sum at x; with -single checks phi_o + phi_s + S2 at
+// x, x+STEP, ... (NUM values) against it, and with -batch the same NUM
+// values from one fullsum_batch, then a batch of x/1000 .. x+1 against
+// each x on its own
 
 #define NUM 100
 #define STEP 10000000
@@ -45,13 +50,57 @@ void test_fullsum(long long start) {
     }
 }
 
+// the same, with all NUM values from one fullsum_batch sweep
+void test_fullsum_batch(long long start) {
+    bool *prime = get_primes(NUM*STEP + start);
+    ftype naive = calc(0, start-STEP, prime);
+    ftype last = to_ftype(-1);
+    vector<lll> xs;
+    for (long long i = start; i < NUM*STEP + start; i += STEP) xs.push_back(i);
+    vector<ftype> totals;
+    fullsum_batch(xs, totals);
+    for (size_t j = 0; j < xs.size(); j++) {
+        long long i = xs[j];
+        naive += calc(i-STEP+1, i, prime);
+        ftype total = totals[j];
+        if (fabs(total - naive) > to_ftype(EP)) {
+            cout << "naive and calculated off" << endl;
+        }
+        else {
+            cout << "naive and calculated correct" << endl;
+        }
+        cout << "naive: " << naive << endl;
+        cout << "calculated: " << total << endl;
+        if (last != -1 && last - total > EP) {
+            cout << "total went down" << endl;
+        }
+        last = total;
+    }
+}
+
+// one batch of several x, some close together, against each x on its own
+void test_batch_vs_single(long long x) {
+    vector<lll> xs;
+    xs.push_back(x/1000); xs.push_back(x/7); xs.push_back(x/2);
+    xs.push_back(x-1); xs.push_back(x); xs.push_back(x+1);
+    vector<ftype> totals;
+    fullsum_batch(xs, totals);
+    for (size_t j = 0; j < xs.size(); j++) {
+        ftype single = phi_o(xs[j]) + phi_s(xs[j]) + sum1p_and_s2_m1(xs[j]);
+        cout << xs[j] << (fabs(totals[j] - single) > to_ftype(EP) ? ": batch and single off" : ": batch and single agree") << endl;
+        cout << "batch: " << totals[j] << endl;
+        cout << "single: " << single << endl;
+    }
+}
+
 int main(int argc, char *argv[]) {
     cout << setprecision(20);
     cout << fixed;
 
     long long x = atoll(argv[1]);
-    quad_float::SetOutputPrecision(30);
-    //test_fullsum(x);
-    cout << calc(0, x, get_primes(x)) << endl;
+    set_output_precision(30);
+    if (argc > 2 && !strcmp(argv[2], "-single")) test_fullsum(x);
+    else if (argc > 2 && !strcmp(argv[2], "-batch")) { test_fullsum_batch(x); test_batch_vs_single(x); }
+    else cout << calc(0, x, get_primes(x)) << endl;
     return 0;
 }
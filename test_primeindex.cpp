@@ -0,0 +1,94 @@
+// Checks Primeindex against a plain sieve: pi(n) for every n <= N,
+// nth(pi(p)) == p for every prime p <= N, and next(n) for every n <= N+1.
+// Then every N up to 4000, for the last line and the bits past N.  Last,
+// an index that holds a cached bitmap while the cache grows: its map has
+// to stay readable until the index goes, and then be unmapped.
+//
+// Usage: test_primeindex [N, default 1000000]
+
+#include "Primelist.h"
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+using namespace std;
+
+// checks the index of [0, N] against c[n] = pi(n), printing the first error
+bool check(long N, const vector<long> &c) {
+    Primeindex I(N);
+    if (I.max() != N || I.pi(N) != c[N] || I.pi(N+1000) != c[N]) {
+        cout << "N = " << N << ": pi(N) = " << I.pi(N) << ", want " << c[N] << endl;
+        return false;
+    }
+    long nextp = 0;
+    for (long n = N; n >= 0; n--) {
+        if (c[n] != (n ? c[n-1] : 0)) nextp = n;
+        if (I.pi(n) != c[n] || I.next(n) != nextp) {
+            cout << "N = " << N << ", n = " << n << ": pi " << I.pi(n) << ", next " << I.next(n)
+                 << ", want " << c[n] << ", " << nextp << endl;
+            return false;
+        }
+        if (nextp == n && nextp && I.nth(c[n]) != n) {
+            cout << "N = " << N << ": nth(" << c[n] << ") = " << I.nth(c[n]) << ", want " << n << endl;
+            return false;
+        }
+    }
+    if (I.next(N+1) != 0) {
+        cout << "N = " << N << ": next(N+1) = " << I.next(N+1) << ", want 0" << endl;
+        return false;
+    }
+    return true;
+}
+
+// mappings of file f in this process
+int mappings(const string &f) {
+    ifstream in("/proc/self/maps");
+    string line;
+    int n = 0;
+    while (getline(in, line)) if (line.find(f) != string::npos) n++;
+    return n;
+}
+
+bool check_cache() {
+    string f = "/tmp/test_primeindex." + to_string(getpid());
+    setenv("PRIMECACHE", f.c_str(), 1);
+    bool ok = true;
+    Primecache::reserve(PC_MINLIMIT);
+    Primeindex *A = new Primeindex(PC_MINLIMIT);    // holds the small map
+    Primecache::reserve(2*PC_MINLIMIT);             // replaces it
+    Primeindex B(2*PC_MINLIMIT);
+    if (mappings(f) != 2 || A->pi(PC_MINLIMIT) != 664579 || B.pi(2*PC_MINLIMIT) != 1270607) {
+        cout << "cache: " << mappings(f) << " maps, pi " << A->pi(PC_MINLIMIT) << ", " << B.pi(2*PC_MINLIMIT) << endl;
+        ok = false;
+    }
+    delete A;                                       // the small map goes with it
+    if (mappings(f) != 1 || B.pi(PC_MINLIMIT) != 664579) {
+        cout << "cache: " << mappings(f) << " maps after release, want 1" << endl;
+        ok = false;
+    }
+    unlink(f.c_str());
+    setenv("PRIMECACHE", "none", 1);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    long N = argc > 1 ? atol(argv[1]) : 1000000;
+    if (N < 4000) N = 4000;
+    setenv("PRIMECACHE", "none", 1);   // the index's own sieve, not a file
+
+    vector<char> prime(N+1, 1);
+    prime[0] = 0; prime[1] = 0;
+    for (long p = 2; p*p <= N; p++) if (prime[p])
+        for (long m = p*p; m <= N; m += p) prime[m] = 0;
+    vector<long> c(N+1);
+    for (long n = 0; n <= N; n++) c[n] = (n ? c[n-1] : 0) + prime[n];
+
+    bool ok = check(N, c);
+    for (long n = 0; ok && n <= 4000; n++) ok = check(n, c);
+    ok = ok && check_cache();
+    cout << "primeindex up to " << N << (ok ? " passed" : " FAILED") << endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+// Sends server a mixed batch and checks that the sum replies after a
+// crossover come out as they do in a batch of their own: find_crossover
+// sets the output precision, and the replies after it used to keep that.
+// Then that x and y out of range get error lines, not a wrong answer (an
+// x that overflows), a hang (y < 1/2) or a crash (y past the sum at 10^22).
+//
+// Usage: test_server [path to server, default ./server]
+
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+vector<string> ask(const string &server, const string &requests) {
+    string cmd = "printf '" + requests + "' | " + server + " 2>/dev/null";
+    vector<string> lines;
+    FILE *f = popen(cmd.c_str(), "r");
+    if (f == NULL) return lines;
+    char buf[512];
+    while (fgets(buf, sizeof(buf), f)) {
+        string s(buf);
+        if (!s.empty() && s[s.size()-1] == '\n') s.erase(s.size()-1);
+        lines.push_back(s);
+    }
+    pclose(f);
+    return lines;
+}
+
+int main(int argc, char *argv[]) {
+    string server = argc > 1 ? argv[1] : "./server";
+    vector<string> alone = ask(server, "sum 1000000\\nparts 1000000\\n");
+    vector<string> mixed = ask(server, "sum 1000000\\ncrossover 2.4\\nsum 1000000\\nparts 1000000\\n");
+    bool ok = alone.size() == 2 && mixed.size() == 4
+        && mixed[0] == alone[0] && mixed[2] == alone[0] && mixed[3] == alone[1]
+        && mixed[1] == "crossover 2.4 4789";
+    for (size_t i = 0; i < mixed.size(); i++) cout << mixed[i] << endl;
+
+    const char *bad[] = { "sum 7", "sum 10000000000000000000001",
+        "parts 340282366920938463463374607431768211457", "crossover 0.3", "crossover 4.2",
+        "crossover 9" };
+    string requests;
+    for (size_t i = 0; i < sizeof(bad)/sizeof(bad[0]); i++) requests += string(bad[i]) + "\\n";
+    vector<string> errors = ask(server, requests + "sum 1000000\\n");
+    ok = ok && errors.size() == sizeof(bad)/sizeof(bad[0]) + 1 && errors.back() == alone[0];
+    for (size_t i = 0; ok && i + 1 < errors.size(); i++)
+        ok = errors[i] == "error " + string(bad[i]);
+    for (size_t i = 0; i < errors.size(); i++) cout << errors[i] << endl;
+    cout << (ok ? "passed" : "FAILED") << endl;
+    return ok ? 0 : 1;
+}
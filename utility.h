@@ -1,44 +1,178 @@
 #ifndef _UTILITY
 #define _UTILITY
 
-#define DEBUG 0
-#define DEBUG_BS 1
-#define DEBUG_SP 0
-#define DEBUG_OD 0
-#define DEBUG_S2 0
-#define DEBUG_EG 1
 #define EP 1e-20
 
 #include <cstdio>
-#include <NTL/quad_float.h>
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include "perfregion.h"   // PERF_REGION, for -DPERF_REGIONS builds
+#include "progress.h"     // Progress: ETA and the SIGUSR1 state dump
+#include "arena.h"        // Arena: big tables on 2 MB pages, peak usage
 //#include <NTL/RR.h>  // If using RR. Changing functions here applies to all files
 
 using namespace std;
+
+// The floating type ftype is picked at compile time:
+//
+//   (default)        NTL quad_float, the reference.  ~106 bits, about 32
+//                    digits; every operation is an out-of-line library call.
+//   -DFTYPE_DD       inline FMA double-double (ddouble.h).  Same ~106 bits,
+//                    add/mul good to 3u^2/2u^2 (u = 2^-53), all inline.
+//   -DFTYPE_FLOAT128 GCC __float128 (needs -lquadmath).  113 bits, correctly
+//                    rounded (2^-113 ~ 1e-34 per op) but done in software.
+//   -DFTYPE_DOUBLE   plain double.  53 bits, 2^-53 ~ 1.1e-16 per op, so sums
+//                    are good to ~1e-13 at best; for fast exploratory runs.
+//
+// Code outside this file should only use the ftype functions below
+// (to_ftype, ftoll, ftod, set_output_precision) and the usual arithmetic,
+// comparisons, floor, ceil, fabs, sqrt, log and exp, so it works with all four.
+
+#if defined(FTYPE_DD)
+
+#include "ddouble.h"
+typedef dd ftype;
+
+ftype to_ftype(double n) { return dd(n); }
+ftype to_ftype(const char* n) { return to_dd(n); }
+long long ftoll(ftype x) { return to_long(x); }
+double ftod(ftype x) { return to_double(x); }
+void set_output_precision(long p) { dd::SetOutputPrecision(p); }
+
+#elif defined(FTYPE_FLOAT128)
+
+extern "C" {
+#include <quadmath.h>
+}
+typedef __float128 ftype;
+
+inline ftype floor(ftype x) { return floorq(x); }
+inline ftype ceil(ftype x) { return ceilq(x); }
+inline ftype fabs(ftype x) { return fabsq(x); }
+inline ftype sqrt(ftype x) { return sqrtq(x); }
+inline ftype log(ftype x) { return logq(x); }
+inline ftype exp(ftype x) { return expq(x); }
+
+long ftype_oprec = 10;
+inline ostream & operator<<(ostream &os, ftype x) {
+    char buf[64];
+    quadmath_snprintf(buf, sizeof(buf), "%.*Qg", (int)ftype_oprec, x);
+    return os << buf;
+}
+
+ftype to_ftype(double n) { return n; }
+ftype to_ftype(const char* n) { return strtoflt128(n, NULL); }
+long long ftoll(ftype x) { return (long long)x; }
+double ftod(ftype x) { return (double)x; }
+void set_output_precision(long p) { ftype_oprec = p > 36 ? 36 : p; }
+
+#elif defined(FTYPE_DOUBLE)
+
+typedef double ftype;
+
+ftype to_ftype(double n) { return n; }
+ftype to_ftype(const char* n) { return atof(n); }
+long long ftoll(ftype x) { return (long long)x; }
+double ftod(ftype x) { return x; }
+void set_output_precision(long p) { cout.precision(p > 17 ? 17 : p); cerr.precision(p > 17 ? 17 : p); }
+
+#else
+
+#include <NTL/quad_float.h>   // only this backend needs NTL, to build or to link
+
 using namespace NTL;
 
 typedef quad_float ftype;
 
-ftype to_ftype(long long n)
+ftype to_ftype(double n) { return to_quad_float(n); }
+ftype to_ftype(const char* n) { return to_quad_float(n); }
+long long ftoll(ftype x) { return to_long(x); }
+double ftod(ftype x) { return to_double(x); }
+void set_output_precision(long p) { quad_float::SetOutputPrecision(p); }
+
+#endif
+
+ftype to_ftype(long long n)  // exact: both 32-bit halves fit in a double
 {
-    char s[30];
-    sprintf(s,"%lld%c",n,0);
-    return to_quad_float(s);
+    return to_ftype((double)(n & ~0xffffffffLL)) + to_ftype((double)(n & 0xffffffffLL));
 }
 
-ftype to_ftype(double n) {
-    return to_quad_float(n);
+ftype to_ftype(int n) {
+    return to_ftype((double)n);
 }
 
-ftype to_ftype(int n) {
-    return to_quad_float(n);
+ftype to_ftype(long n) {
+    return to_ftype((long long)n);
 }
 
-ftype to_ftype(const char* n) {
-    return to_quad_float(n);
+// x itself may go past 2^63 (up to about 10^22), so x and the numbers of
+// its size are lll.  Everything derived from x^(2/3) or less still fits
+// in a long long, and the helpers below take the 64-bit path when they can.
+typedef __int128 lll;
+
+ftype to_ftype(lll n)  // exact for |n| < 2^106
+{
+    if (n == (long long)n) return to_ftype((long long)n);
+    ftype hi = to_ftype((long long)(n >> 64)) * 18446744073709551616.0;
+    unsigned long long lo = (unsigned long long)n;
+    return hi + to_ftype((long long)(lo >> 32)) * 4294967296.0
+              + to_ftype((long long)(lo & 0xffffffffULL));
 }
 
-ftype to_ftype(long n) {
-    return to_ftype((long long)n);
+lll ftolll(ftype x)  // truncates, like ftoll, for x >= 0
+{
+    if (x < 9e18) return ftoll(x);
+    lll q = ftoll(floor(x / 4294967296.0));
+    return (q << 32) + ftoll(x - to_ftype(q) * 4294967296.0);
+}
+
+lll to_lll(const char *s)  // decimal digits, stops at anything else
+{
+    lll n = 0;
+    for (; *s >= '0' && *s <= '9'; s++) n = 10*n + (*s - '0');
+    return n;
+}
+
+ostream & operator<<(ostream &os, lll n)
+{
+    char buf[48];
+    int i = sizeof(buf) - 1;
+    bool neg = n < 0;
+    if (neg) n = -n;
+    buf[i] = 0;
+    do { buf[--i] = '0' + (int)(n % 10); n /= 10; } while (n);
+    if (neg) buf[--i] = '-';
+    return os << buf + i;
+}
+
+// x/m and x%m for m < 2^63; the quotient of x/m must fit in a long long
+inline long long xdiv(lll x, long long m) {
+    if (x == (long long)x) return (long long)x / m;
+    return (long long)(x / m);
+}
+
+inline long long xmod(lll x, long long m) {
+    if (x == (long long)x) return (long long)x % m;
+    return (long long)(x % m);
+}
+
+// floor(x^(1/3)) and floor(sqrt(x)), exactly: the root in doubles is off
+// by at most one past 2^53, and is moved until r^3 <= x < (r+1)^3
+inline long long icbrt(lll x) {
+    if (x <= 0) return 0;
+    long long r = (long long)cbrt((double)x);
+    while (r > 0 && (lll)r*r*r > x) r--;
+    while ((lll)(r+1)*(r+1)*(r+1) <= x) r++;
+    return r;
+}
+
+inline long long isqrt(lll x) {
+    if (x <= 0) return 0;
+    long long r = (long long)sqrt((double)x);
+    while (r > 0 && (lll)r*r > x) r--;
+    while ((lll)(r+1)*(r+1) <= x) r++;
+    return r;
 }
 
 typedef long long T;
@@ -100,6 +234,63 @@ bool is_prime(T n) {
     return true;
 }
 
+// a*b mod m for m < 2^94: b is taken 32 bits at a time, so no
+// intermediate product needs more than 127 bits
+lll mult_mod(lll a, lll b, lll m) {
+    lll r = (a * (b >> 64)) % m;
+    r = ((r << 32) + a * ((b >> 32) & 0xffffffff)) % m;
+    r = ((r << 32) + a * (b & 0xffffffff)) % m;
+    return r;
+}
+
+lll pow_mod(lll a, lll b, lll m) {
+    lll r = 1;
+    a %= m;
+    for (; b; b >>= 1) {
+        if (b & 1) r = mult_mod(r, a, m);
+        a = mult_mod(a, a, m);
+    }
+    return r;
+}
+
+/* Miller-Rabin for x beyond 2^63.  Below that we use the 64-bit version.
+ * Taking the primes <= 41 as bases is deterministic for n < 3.3*10^24
+ * (Sorenson and Webster), which covers every x this code handles.
+ */
+bool is_prime(lll n) {
+    if (n == (long long)n) return is_prime((long long)n);
+    T small_primes[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41};
+    for (int i = 0; i < 13; ++i)
+        if (n % small_primes[i] == 0)
+            return false;
+    lll d = n - 1;
+    int s = 0;
+    for (; d % 2 == 0; d /= 2, ++s);
+    for (int i = 0; i < 13; ++i) {
+        lll t = pow_mod((lll)small_primes[i], d, n);
+        if (t == 1 || t == n - 1) continue;
+        bool found = false;
+        for (int r = 1; r < s; ++r) {
+            t = mult_mod(t, t, n);
+            if (t == n - 1) {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            return false;
+    }
+    return true;
+}
+
+bool is_prime(int n) {
+    return is_prime((long long)n);
+}
+
+bool is_prime(long n) {
+    return is_prime((long long)n);
+}
+
 bool * get_primes(long long x) {
     bool *prime = new bool[x+1];
     memset(prime, true, (x+1)*sizeof(bool));
@@ -115,5 +306,6 @@ bool * get_primes(long long x) {
     return prime;
 }
 
+#include "log.h"          // LOG(sub, level): tracing picked at run time; after lll's <<
 
 #endif
@@ -0,0 +1,155 @@
+// Leaf weights for the sieve engine
+//
+// The Meissel-Lehmer split works for sum f(p), p <= x, with any
+// completely multiplicative f: the node (x/m, b) contributes
+// mu(m) f(m) phi_f(x/m, b), where phi_f(y, b) sums f(n) over the n <= y
+// with no prime factor <= p_b.  So only the leaves know what f is, and a
+// weight policy W tells them:
+//
+//    typedef ... value;                      what sums of f are kept in
+//    static value zero();
+//    static value leaf(long long t);         f(t)
+//    static value scale(const value &v, long long m);    f(m) v
+//    static value oddsum(lll y);             sum f(n) over odd n <= y
+//    static const bool multiplicative;
+//
+// oddsum is phi_f(y, 1), which phi_o needs in closed form for y >=
+// x^(2/3); a weight without one can't go through phi_o.
+//
+//    Wrecip      f = 1/t, what everything defaults to
+//    Wcount      f = 1, in long long: exact trees and sums, and
+//                phi_s + phi_o + S2 is pi(x) (for x < 2^63)
+//    Wpower      f = t^-s, s set at run time with Wpower::set(s)
+//    Wlog        f = log t, which is additive, not multiplicative, so only
+//                for sums over the survivors of a sieve (RangeArray,
+//                Primesums); phi_s, phi_o and S2 refuse it
+//    Wboth<A,B>  A and B side by side, so one sweep gives both sums
+
+#ifndef _WEIGHT
+#define _WEIGHT
+
+#include "utility.h"
+#include <iostream>
+
+using namespace std;
+
+struct Wrecip
+{
+    typedef ftype value;
+    static const bool multiplicative = true;
+
+    static value zero() { return to_ftype(0); }
+    static value leaf(long long t) { return 1/to_ftype(t); }
+    static value scale(const value &v, long long m) { return v/m; }
+
+    // Euler-Maclaurin for the odd harmonic sum up to the odd y; the first
+    // term left out is 1/(15 y^4), and y >= x^(2/3) here
+    static value oddsum(lll q) {
+        static const ftype gamma = to_ftype("0.57721566490153286060651209008240243");
+        static const ftype log2 = to_ftype("0.69314718055994530941723212145817657");
+        ftype y = to_ftype(q - 1 + (q&1));   // largest odd <= q
+        ftype y2 = y*y;
+        return log(y)/2 + (gamma + log2)/2 + 1/(2*y) - 1/(6*y2);
+    }
+};
+
+struct Wcount
+{
+    typedef long long value;
+    static const bool multiplicative = true;
+
+    static value zero() { return 0; }
+    static value leaf(long long) { return 1; }
+    static value scale(const value &v, long long) { return v; }
+    static value oddsum(lll q) { return (long long)((q + 1)/2); }
+};
+
+struct Wpower
+{
+    typedef ftype value;
+    static const bool multiplicative = true;
+    static ftype s, C;   // C: the constant of oddsum, (1-2^-s) zeta(s) for s > 1
+
+    static value zero() { return to_ftype(0); }
+    static value leaf(long long t) { return exp(-s*log(to_ftype(t))); }
+    static value scale(const value &v, long long m) { return v*leaf(m); }
+
+    // Euler-Maclaurin for the sum of n^-s over odd n <= the odd y, less C;
+    // the first term left out is B_14/14! 2^13 s(s+1)..(s+12) y^(-s-13)
+    static value tail(ftype y) {
+        static const int Bn[6] = { 1, -1, 1, -1, 5, -691 }, Bd[6] = { 6, 30, 42, 30, 66, 2730 };   // B_2k
+        ftype t = exp(-s*log(y)), r = t*y/(2*(1-s)) + t/2, c = s;   // c = 2^(2k-1) s(s+1)..(s+2k-2)/(2k)!
+        for (int k = 1; k <= 6; k++) {
+            t /= y*y;
+            r -= to_ftype(Bn[k-1])*c*t*y/Bd[k-1];
+            c *= 4*(s+2*k-1)*(s+2*k)/((2*k+1)*(2*k+2));
+        }
+        return r;
+    }
+
+    static void set(const ftype &e) {   // C from the odd n up to 999
+        s = e;
+        if (s == 1) return;
+        C = zero();
+        for (long n = 999; n >= 1; n -= 2) C += leaf(n);
+        C -= tail(to_ftype(999));
+    }
+
+    // for y >= x^(2/3), at s = 1 the odd harmonic sum of Wrecip
+    static value oddsum(lll q) {
+        if (s == 1) return Wrecip::oddsum(q);
+        return C + tail(to_ftype(q - 1 + (q&1)));   // largest odd <= q
+    }
+};
+
+ftype Wpower::s = to_ftype(1);
+ftype Wpower::C = to_ftype(0);
+
+struct Wlog
+{
+    typedef ftype value;
+    static const bool multiplicative = false;
+
+    static value zero() { return to_ftype(0); }
+    static value leaf(long long t) { return log(to_ftype(t)); }
+};
+
+// The sums of two weights, added and scaled componentwise
+template <class A, class B>
+struct Wpair
+{
+    typename A::value a;
+    typename B::value b;
+
+    Wpair() {}
+    Wpair(const typename A::value &u, const typename B::value &v) : a(u), b(v) {}
+
+    Wpair & operator+=(const Wpair &o) { a += o.a; b += o.b; return *this; }
+    Wpair & operator-=(const Wpair &o) { a -= o.a; b -= o.b; return *this; }
+};
+
+template <class A, class B>
+inline Wpair<A, B> operator+(Wpair<A, B> u, const Wpair<A, B> &v) { return u += v; }
+
+template <class A, class B>
+inline Wpair<A, B> operator-(Wpair<A, B> u, const Wpair<A, B> &v) { return u -= v; }
+
+template <class A, class B>
+inline Wpair<A, B> operator-(const Wpair<A, B> &u) { return Wpair<A, B>(-u.a, -u.b); }
+
+template <class A, class B>
+inline ostream & operator<<(ostream &os, const Wpair<A, B> &u) { return os << u.a << " " << u.b; }
+
+template <class A, class B>
+struct Wboth
+{
+    typedef Wpair<A, B> value;
+    static const bool multiplicative = A::multiplicative && B::multiplicative;
+
+    static value zero() { return value(A::zero(), B::zero()); }
+    static value leaf(long long t) { return value(A::leaf(t), B::leaf(t)); }
+    static value scale(const value &v, long long m) { return value(A::scale(v.a, m), B::scale(v.b, m)); }
+    static value oddsum(lll q) { return value(A::oddsum(q), B::oddsum(q)); }
+};
+
+#endif